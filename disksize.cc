@@ -20,11 +20,14 @@
   along with this program; if not, write to the Free Software
   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
 
+#include <climits>
 #include <list>
 #include <string>
 #include <components/disksize/disksize.h>
 
 REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_register);
+REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_unregister);
+REQUIRES_SERVICE_PLACEHOLDER(status_variable_registration);
 
 REQUIRES_SERVICE_PLACEHOLDER(log_builtins);
 REQUIRES_SERVICE_PLACEHOLDER(log_builtins_string);
@@ -66,6 +69,647 @@ bool have_required_privilege(void *opaque_thd)
   return false;
 }
 
+static void update_refresh_interval(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                    const void *save)
+{
+  *static_cast<unsigned int *>(var_ptr) =
+      *static_cast<const unsigned int *>(save);
+  disksize_collector_wakeup();
+}
+
+static void update_dir_usage_interval(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                      const void *save)
+{
+  *static_cast<unsigned int *>(var_ptr) =
+      *static_cast<const unsigned int *>(save);
+  disksize_dir_usage_wakeup();
+}
+
+static void update_page_cache_interval(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                       const void *save)
+{
+  *static_cast<unsigned int *>(var_ptr) =
+      *static_cast<const unsigned int *>(save);
+  disksize_page_cache_wakeup();
+}
+
+static void update_temp_sample_interval(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                        const void *save)
+{
+  unsigned int interval = *static_cast<const unsigned int *>(save);
+  // 0 disables the sampler, any other value is at least the minimum
+  if (interval > 0 && interval < DISKSIZE_MIN_TEMP_SAMPLE_INTERVAL)
+    interval = DISKSIZE_MIN_TEMP_SAMPLE_INTERVAL;
+  *static_cast<unsigned int *>(var_ptr) = interval;
+  disksize_temp_sampler_wakeup();
+}
+
+static void update_prometheus_interval(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                       const void *save)
+{
+  *static_cast<unsigned int *>(var_ptr) =
+      *static_cast<const unsigned int *>(save);
+  disksize_prometheus_wakeup();
+}
+
+static void update_canary_interval(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                   const void *save)
+{
+  *static_cast<unsigned int *>(var_ptr) =
+      *static_cast<const unsigned int *>(save);
+  disksize_canary_wakeup();
+}
+
+static void update_fragmentation_interval(MYSQL_THD, SYS_VAR *, void *var_ptr,
+                                          const void *save)
+{
+  *static_cast<unsigned int *>(var_ptr) =
+      *static_cast<const unsigned int *>(save);
+  disksize_fragmentation_wakeup();
+}
+
+/* Names of the system variables registered so far, for the cleanup */
+static std::vector<const char *> registered_variables;
+
+static bool register_variable(const char *name, int flags,
+                              const char *comment,
+                              mysql_sys_var_update_func update,
+                              void *check_arg, void *variable_value)
+{
+  char msgbuf[1024];
+
+  if (mysql_service_component_sys_variable_register->register_variable(
+          "disksize", name, flags, comment, nullptr, update, check_arg,
+          variable_value))
+  {
+    sprintf(msgbuf, "disksize.%s register failed.", name);
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+    return true;
+  }
+  registered_variables.push_back(name);
+  return false;
+}
+
+static void unregister_system_variables()
+{
+  char msgbuf[1024];
+
+  for (const char *name : registered_variables)
+  {
+    if (mysql_service_component_sys_variable_unregister->unregister_variable(
+            "disksize", name))
+    {
+      sprintf(msgbuf, "disksize.%s unregister failed.", name);
+      LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+    }
+  }
+  registered_variables.clear();
+}
+
+static bool register_system_variables()
+{
+  INTEGRAL_CHECK_ARG(uint) refresh_interval_arg, min_refresh_interval_arg,
+      forecast_half_life_arg,
+      dir_usage_interval_arg, dir_usage_threads_arg, probe_threads_arg,
+      probe_timeout_arg, page_cache_interval_arg, page_cache_scan_rate_arg,
+      fragmentation_interval_arg, fragmentation_scan_rate_arg,
+      temp_sample_interval_arg,
+      temp_peak_window_arg, prometheus_interval_arg, canary_interval_arg,
+      warning_free_pct_arg, critical_free_pct_arg, alert_hysteresis_pct_arg;
+  refresh_interval_arg.def_val = DISKSIZE_DEFAULT_REFRESH_INTERVAL;
+  refresh_interval_arg.min_val = 1;
+  refresh_interval_arg.max_val = 86400;
+  refresh_interval_arg.blk_sz = 0;
+
+  min_refresh_interval_arg.def_val = DISKSIZE_DEFAULT_MIN_REFRESH_INTERVAL;
+  min_refresh_interval_arg.min_val = 1;
+  min_refresh_interval_arg.max_val = 86400;
+  min_refresh_interval_arg.blk_sz = 0;
+
+  forecast_half_life_arg.def_val = DISKSIZE_DEFAULT_FORECAST_HALF_LIFE;
+  forecast_half_life_arg.min_val = 1;
+  forecast_half_life_arg.max_val = 604800;
+  forecast_half_life_arg.blk_sz = 0;
+
+  dir_usage_interval_arg.def_val = DISKSIZE_DEFAULT_DIR_USAGE_INTERVAL;
+  dir_usage_interval_arg.min_val = 0;
+  dir_usage_interval_arg.max_val = 604800;
+  dir_usage_interval_arg.blk_sz = 0;
+
+  dir_usage_threads_arg.def_val = DISKSIZE_DEFAULT_DIR_USAGE_THREADS;
+  dir_usage_threads_arg.min_val = 1;
+  dir_usage_threads_arg.max_val = 64;
+  dir_usage_threads_arg.blk_sz = 0;
+
+  probe_threads_arg.def_val = DISKSIZE_DEFAULT_PROBE_THREADS;
+  probe_threads_arg.min_val = 1;
+  probe_threads_arg.max_val = 64;
+  probe_threads_arg.blk_sz = 0;
+
+  probe_timeout_arg.def_val = DISKSIZE_DEFAULT_PROBE_TIMEOUT;
+  probe_timeout_arg.min_val = 10;
+  probe_timeout_arg.max_val = 600000;
+  probe_timeout_arg.blk_sz = 0;
+
+  page_cache_interval_arg.def_val = DISKSIZE_DEFAULT_PAGE_CACHE_INTERVAL;
+  page_cache_interval_arg.min_val = 0;
+  page_cache_interval_arg.max_val = 604800;
+  page_cache_interval_arg.blk_sz = 0;
+
+  page_cache_scan_rate_arg.def_val = DISKSIZE_DEFAULT_PAGE_CACHE_SCAN_RATE;
+  page_cache_scan_rate_arg.min_val = 1;
+  page_cache_scan_rate_arg.max_val = 1024 * 1024;
+  page_cache_scan_rate_arg.blk_sz = 0;
+
+  fragmentation_interval_arg.def_val = DISKSIZE_DEFAULT_FRAGMENTATION_INTERVAL;
+  fragmentation_interval_arg.min_val = 0;
+  fragmentation_interval_arg.max_val = 604800;
+  fragmentation_interval_arg.blk_sz = 0;
+
+  fragmentation_scan_rate_arg.def_val =
+      DISKSIZE_DEFAULT_FRAGMENTATION_SCAN_RATE;
+  fragmentation_scan_rate_arg.min_val = 1;
+  fragmentation_scan_rate_arg.max_val = 1000000;
+  fragmentation_scan_rate_arg.blk_sz = 0;
+
+  temp_sample_interval_arg.def_val = DISKSIZE_DEFAULT_TEMP_SAMPLE_INTERVAL;
+  temp_sample_interval_arg.min_val = 0;
+  temp_sample_interval_arg.max_val = 60000;
+  temp_sample_interval_arg.blk_sz = 0;
+
+  temp_peak_window_arg.def_val = DISKSIZE_DEFAULT_TEMP_PEAK_WINDOW;
+  temp_peak_window_arg.min_val = 1;
+  temp_peak_window_arg.max_val = 86400;
+  temp_peak_window_arg.blk_sz = 0;
+
+  prometheus_interval_arg.def_val = DISKSIZE_DEFAULT_PROMETHEUS_INTERVAL;
+  prometheus_interval_arg.min_val = 1;
+  prometheus_interval_arg.max_val = 86400;
+  prometheus_interval_arg.blk_sz = 0;
+
+  canary_interval_arg.def_val = DISKSIZE_DEFAULT_CANARY_INTERVAL;
+  canary_interval_arg.min_val = 0;
+  canary_interval_arg.max_val = 86400;
+  canary_interval_arg.blk_sz = 0;
+
+  warning_free_pct_arg.def_val = DISKSIZE_DEFAULT_WARNING_FREE_PCT;
+  warning_free_pct_arg.min_val = 0;
+  warning_free_pct_arg.max_val = 100;
+  warning_free_pct_arg.blk_sz = 0;
+
+  critical_free_pct_arg.def_val = DISKSIZE_DEFAULT_CRITICAL_FREE_PCT;
+  critical_free_pct_arg.min_val = 0;
+  critical_free_pct_arg.max_val = 100;
+  critical_free_pct_arg.blk_sz = 0;
+
+  alert_hysteresis_pct_arg.def_val = DISKSIZE_DEFAULT_ALERT_HYSTERESIS_PCT;
+  alert_hysteresis_pct_arg.min_val = 0;
+  alert_hysteresis_pct_arg.max_val = 100;
+  alert_hysteresis_pct_arg.blk_sz = 0;
+
+  STR_CHECK_ARG(str) shm_path_arg, prometheus_dir_arg, watermarks_arg;
+  shm_path_arg.def_val = nullptr;
+  prometheus_dir_arg.def_val = nullptr;
+  watermarks_arg.def_val = nullptr;
+
+  INTEGRAL_CHECK_ARG(ulong) history_size_arg, history_max_memory_arg,
+      warning_free_bytes_arg, critical_free_bytes_arg;
+  history_size_arg.def_val = DISKSIZE_DEFAULT_HISTORY_SIZE;
+  history_size_arg.min_val = 0;
+  history_size_arg.max_val = 100000000;
+  history_size_arg.blk_sz = 0;
+
+  history_max_memory_arg.def_val = DISKSIZE_DEFAULT_HISTORY_MAX_MEMORY;
+  history_max_memory_arg.min_val = 0;
+  history_max_memory_arg.max_val = 1024 * 1024 * 1024;
+  history_max_memory_arg.blk_sz = 0;
+
+  warning_free_bytes_arg.def_val = 0;
+  warning_free_bytes_arg.min_val = 0;
+  warning_free_bytes_arg.max_val = ULONG_MAX;
+  warning_free_bytes_arg.blk_sz = 0;
+
+  critical_free_bytes_arg.def_val = 0;
+  critical_free_bytes_arg.min_val = 0;
+  critical_free_bytes_arg.max_val = ULONG_MAX;
+  critical_free_bytes_arg.blk_sz = 0;
+
+  if (register_variable(
+          "refresh_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds between two samples of the monitored directories",
+          update_refresh_interval, (void *)&refresh_interval_arg,
+          (void *)&disksize_refresh_interval) ||
+      register_variable(
+          "min_refresh_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Minimum number of seconds between two samples of a filesystem "
+          "filling up or short of space",
+          nullptr, (void *)&min_refresh_interval_arg,
+          (void *)&disksize_min_refresh_interval) ||
+      register_variable(
+          "forecast_half_life",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds after which a sample only weights half as much "
+          "in the FILL_RATE of disks_size",
+          nullptr, (void *)&forecast_half_life_arg,
+          (void *)&disksize_forecast_half_life) ||
+      register_variable(
+          "history_size",
+          PLUGIN_VAR_LONG | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG |
+              PLUGIN_VAR_READONLY,
+          "Maximum number of rows kept in performance_schema.disks_size_history",
+          nullptr, (void *)&history_size_arg, (void *)&disksize_history_size) ||
+      register_variable(
+          "history_max_memory",
+          PLUGIN_VAR_LONG | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG |
+              PLUGIN_VAR_READONLY,
+          "Maximum number of bytes used by performance_schema.disks_size_history",
+          nullptr, (void *)&history_max_memory_arg,
+          (void *)&disksize_history_max_memory) ||
+      register_variable(
+          "dir_usage_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds between two walks of the monitored directories "
+          "for performance_schema.disks_usage_by_dir, 0 to disable them",
+          update_dir_usage_interval, (void *)&dir_usage_interval_arg,
+          (void *)&disksize_dir_usage_interval) ||
+      register_variable(
+          "dir_usage_threads",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of threads walking the monitored directories",
+          nullptr, (void *)&dir_usage_threads_arg,
+          (void *)&disksize_dir_usage_threads) ||
+      register_variable(
+          "probe_threads",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG |
+              PLUGIN_VAR_READONLY,
+          "Number of threads running the stat() and statvfs() calls",
+          nullptr, (void *)&probe_threads_arg,
+          (void *)&disksize_probe_threads) ||
+      register_variable(
+          "probe_timeout",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of milliseconds to wait for a filesystem before reporting "
+          "its last known values as stale",
+          nullptr, (void *)&probe_timeout_arg,
+          (void *)&disksize_probe_timeout) ||
+      register_variable(
+          "page_cache_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds between two scans for "
+          "performance_schema.disks_page_cache, 0 to disable them",
+          update_page_cache_interval, (void *)&page_cache_interval_arg,
+          (void *)&disksize_page_cache_interval) ||
+      register_variable(
+          "page_cache_scan_rate",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Maximum number of MiB of files checked per second for "
+          "performance_schema.disks_page_cache",
+          nullptr, (void *)&page_cache_scan_rate_arg,
+          (void *)&disksize_page_cache_scan_rate) ||
+      register_variable(
+          "fragmentation_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds between two passes for "
+          "performance_schema.disks_fragmentation, 0 to disable them",
+          update_fragmentation_interval, (void *)&fragmentation_interval_arg,
+          (void *)&disksize_fragmentation_interval) ||
+      register_variable(
+          "fragmentation_scan_rate",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Maximum number of FS_IOC_FIEMAP calls per second for "
+          "performance_schema.disks_fragmentation",
+          nullptr, (void *)&fragmentation_scan_rate_arg,
+          (void *)&disksize_fragmentation_scan_rate) ||
+      register_variable(
+          "temp_sample_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of milliseconds between two samples of the temporary "
+          "directories for performance_schema.disks_temp_peaks, 0 to "
+          "disable them, at least 10 otherwise",
+          update_temp_sample_interval, (void *)&temp_sample_interval_arg,
+          (void *)&disksize_temp_sample_interval) ||
+      register_variable(
+          "temp_peak_window",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds covered by one row of "
+          "performance_schema.disks_temp_peaks",
+          nullptr, (void *)&temp_peak_window_arg,
+          (void *)&disksize_temp_peak_window) ||
+      register_variable(
+          "shm_path",
+          PLUGIN_VAR_STR | PLUGIN_VAR_MEMALLOC | PLUGIN_VAR_RQCMDARG |
+              PLUGIN_VAR_READONLY,
+          "File the collector maps and copies every sample to, for readers "
+          "without a MySQL connection. Empty to disable it",
+          nullptr, (void *)&shm_path_arg, (void *)&disksize_shm_path) ||
+      register_variable(
+          "prometheus_dir",
+          PLUGIN_VAR_STR | PLUGIN_VAR_MEMALLOC | PLUGIN_VAR_RQCMDARG |
+              PLUGIN_VAR_READONLY,
+          "Directory of the node_exporter textfile collector the samples are "
+          "exported to. Empty to disable the export",
+          nullptr, (void *)&prometheus_dir_arg,
+          (void *)&disksize_prometheus_dir) ||
+      register_variable(
+          "prometheus_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds between two exports to disksize.prometheus_dir",
+          update_prometheus_interval, (void *)&prometheus_interval_arg,
+          (void *)&disksize_prometheus_interval) ||
+      register_variable(
+          "canary_interval",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of seconds between two writes of the latency probe on "
+          "every filesystem, 0 to disable them",
+          update_canary_interval, (void *)&canary_interval_arg,
+          (void *)&disksize_canary_interval) ||
+      register_variable(
+          "warning_free_pct",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Percentage of free space below which a warning is logged, 0 to "
+          "disable it",
+          nullptr, (void *)&warning_free_pct_arg,
+          (void *)&disksize_warning_free_pct) ||
+      register_variable(
+          "critical_free_pct",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Percentage of free space below which an error is logged, 0 to "
+          "disable it",
+          nullptr, (void *)&critical_free_pct_arg,
+          (void *)&disksize_critical_free_pct) ||
+      register_variable(
+          "warning_free_bytes",
+          PLUGIN_VAR_LONG | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of free bytes below which a warning is logged, 0 to "
+          "disable it",
+          nullptr, (void *)&warning_free_bytes_arg,
+          (void *)&disksize_warning_free_bytes) ||
+      register_variable(
+          "critical_free_bytes",
+          PLUGIN_VAR_LONG | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Number of free bytes below which an error is logged, 0 to "
+          "disable it",
+          nullptr, (void *)&critical_free_bytes_arg,
+          (void *)&disksize_critical_free_bytes) ||
+      register_variable(
+          "alert_hysteresis_pct",
+          PLUGIN_VAR_INT | PLUGIN_VAR_UNSIGNED | PLUGIN_VAR_RQCMDARG,
+          "Percentage of the filesystem that must be freed above a watermark "
+          "before its alert is cleared",
+          nullptr, (void *)&alert_hysteresis_pct_arg,
+          (void *)&disksize_alert_hysteresis_pct) ||
+      register_variable(
+          "watermarks",
+          PLUGIN_VAR_STR | PLUGIN_VAR_MEMALLOC | PLUGIN_VAR_RQCMDARG |
+              PLUGIN_VAR_READONLY,
+          "Watermarks of given variables, as RELATED_VARIABLE=WARNING/CRITICAL "
+          "separated by commas, each one a percentage or a size",
+          nullptr, (void *)&watermarks_arg, (void *)&disksize_watermarks))
+  {
+    unregister_system_variables();
+    return true;
+  }
+  return false;
+}
+
+/*
+  Status variables, read from the last snapshot like the disksize_query
+  service: a SHOW GLOBAL STATUS does not open the performance_schema tables.
+*/
+static int show_free_bytes(const char *variable, SHOW_VAR *var, char *buf)
+{
+  unsigned long long free_bytes, total_bytes;
+  bool is_stale;
+
+  var->value = buf;
+  if (disksize_query_imp::get_by_variable(variable, &free_bytes, &total_bytes,
+                                          &is_stale))
+  {
+    // Not monitored or no sample yet: an empty value rather than 0
+    var->type = SHOW_UNDEF;
+    return 0;
+  }
+  var->type = SHOW_LONGLONG;
+  *reinterpret_cast<unsigned long long *>(buf) = free_bytes;
+  return 0;
+}
+
+#define DISKSIZE_SHOW_FREE_BYTES(variable)                              \
+  static int show_##variable##_free_bytes(MYSQL_THD, SHOW_VAR *var,     \
+                                          char *buf)                    \
+  {                                                                     \
+    return show_free_bytes(#variable, var, buf);                        \
+  }
+
+DISKSIZE_SHOW_FREE_BYTES(datadir)
+DISKSIZE_SHOW_FREE_BYTES(tmpdir)
+DISKSIZE_SHOW_FREE_BYTES(log_bin_basename)
+DISKSIZE_SHOW_FREE_BYTES(innodb_data_home_dir)
+DISKSIZE_SHOW_FREE_BYTES(innodb_log_group_home_dir)
+DISKSIZE_SHOW_FREE_BYTES(innodb_undo_directory)
+DISKSIZE_SHOW_FREE_BYTES(innodb_temp_tablespaces_dir)
+
+/* Lowest free space among the monitored filesystems, bytes (0) or % (1) */
+static int show_min_free(SHOW_VAR *var, char *buf, bool pct)
+{
+  Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+  bool found = false;
+  unsigned long long min_bytes = 0;
+  double min_pct = 0;
+
+  if (snapshot != nullptr)
+  {
+    for (const Disksize_record &row : snapshot->m_rows)
+    {
+      unsigned long long free_bytes = row.disksize_dir_size_free.val;
+      unsigned long long total_bytes = row.disksize_dir_size_total.val;
+      if (total_bytes == 0)
+        continue;
+      double free_pct = 100.0 * free_bytes / total_bytes;
+      if (!found || free_bytes < min_bytes)
+        min_bytes = free_bytes;
+      if (!found || free_pct < min_pct)
+        min_pct = free_pct;
+      found = true;
+    }
+  }
+  disksize_snapshot_release(snapshot);
+
+  var->value = buf;
+  if (!found)
+    var->type = SHOW_UNDEF;
+  else if (pct)
+  {
+    var->type = SHOW_DOUBLE;
+    *reinterpret_cast<double *>(buf) = min_pct;
+  }
+  else
+  {
+    var->type = SHOW_LONGLONG;
+    *reinterpret_cast<unsigned long long *>(buf) = min_bytes;
+  }
+  return 0;
+}
+
+static int show_min_free_bytes(MYSQL_THD, SHOW_VAR *var, char *buf)
+{
+  return show_min_free(var, buf, false);
+}
+
+static int show_min_free_pct(MYSQL_THD, SHOW_VAR *var, char *buf)
+{
+  return show_min_free(var, buf, true);
+}
+
+static int show_counter(SHOW_VAR *var, char *buf, unsigned long long value)
+{
+  var->type = SHOW_LONGLONG;
+  var->value = buf;
+  *reinterpret_cast<unsigned long long *>(buf) = value;
+  return 0;
+}
+
+static int show_alert_level(MYSQL_THD, SHOW_VAR *var, char *buf)
+{
+  return show_counter(var, buf, disksize_alert_level.load());
+}
+
+static int show_warning_alerts(MYSQL_THD, SHOW_VAR *var, char *buf)
+{
+  return show_counter(var, buf, disksize_warning_alerts.load());
+}
+
+static int show_critical_alerts(MYSQL_THD, SHOW_VAR *var, char *buf)
+{
+  return show_counter(var, buf, disksize_critical_alerts.load());
+}
+
+#define DISKSIZE_STATUS_FREE_BYTES(name, variable)                      \
+  {name, (char *)&show_##variable##_free_bytes, SHOW_FUNC, SHOW_SCOPE_GLOBAL}
+
+static SHOW_VAR disksize_status_variables[] = {
+    DISKSIZE_STATUS_FREE_BYTES("Disksize_datadir_free_bytes", datadir),
+    DISKSIZE_STATUS_FREE_BYTES("Disksize_tmpdir_free_bytes", tmpdir),
+    DISKSIZE_STATUS_FREE_BYTES("Disksize_log_bin_free_bytes",
+                               log_bin_basename),
+    DISKSIZE_STATUS_FREE_BYTES("Disksize_innodb_data_home_dir_free_bytes",
+                               innodb_data_home_dir),
+    DISKSIZE_STATUS_FREE_BYTES("Disksize_innodb_log_group_home_dir_free_bytes",
+                               innodb_log_group_home_dir),
+    DISKSIZE_STATUS_FREE_BYTES("Disksize_innodb_undo_directory_free_bytes",
+                               innodb_undo_directory),
+    DISKSIZE_STATUS_FREE_BYTES("Disksize_innodb_temp_tablespaces_dir_free_bytes",
+                               innodb_temp_tablespaces_dir),
+    {"Disksize_min_free_bytes", (char *)&show_min_free_bytes, SHOW_FUNC,
+     SHOW_SCOPE_GLOBAL},
+    {"Disksize_min_free_pct", (char *)&show_min_free_pct, SHOW_FUNC,
+     SHOW_SCOPE_GLOBAL},
+    {"Disksize_alert_level", (char *)&show_alert_level, SHOW_FUNC,
+     SHOW_SCOPE_GLOBAL},
+    {"Disksize_warning_alerts", (char *)&show_warning_alerts, SHOW_FUNC,
+     SHOW_SCOPE_GLOBAL},
+    {"Disksize_critical_alerts", (char *)&show_critical_alerts, SHOW_FUNC,
+     SHOW_SCOPE_GLOBAL},
+    {nullptr, nullptr, SHOW_UNDEF, SHOW_SCOPE_UNDEF}};
+
+static bool status_variables_registered = false;
+
+static bool register_status_variables()
+{
+  if (mysql_service_status_variable_registration->register_variable(
+          (SHOW_VAR *)&disksize_status_variables))
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Status variables could not be registered");
+    return true;
+  }
+  status_variables_registered = true;
+  return false;
+}
+
+static void unregister_status_variables()
+{
+  if (!status_variables_registered)
+    return;
+  if (mysql_service_status_variable_registration->unregister_variable(
+          (SHOW_VAR *)&disksize_status_variables))
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Status variables could not be unregistered");
+  status_variables_registered = false;
+}
+
+/*
+  Steps of the initialization done so far. A failed step and the
+  deinitialization both undo the steps done, in reverse order.
+*/
+enum Disksize_init_stage {
+  STAGE_NONE,
+  STAGE_DATA,
+  STAGE_IO,
+  STAGE_THREAD_IO,
+  STAGE_LOG_USAGE,
+  STAGE_TEMP_PEAKS,
+  STAGE_SYSTEM_VARIABLES,
+  STAGE_STATUS_VARIABLES,
+  STAGE_HISTORY,
+  STAGE_PROBE_POOL,
+  STAGE_COLLECTOR,
+  STAGE_DIR_USAGE,
+  STAGE_PAGE_CACHE,
+  STAGE_FRAGMENTATION,
+  STAGE_TEMP_SAMPLER,
+  STAGE_PROMETHEUS,
+  STAGE_CANARY
+};
+
+static Disksize_init_stage init_stage = STAGE_NONE;
+
+static void undo_init_stages()
+{
+  if (init_stage >= STAGE_CANARY)
+    disksize_canary_stop();
+  if (init_stage >= STAGE_PROMETHEUS)
+    disksize_prometheus_stop();
+  if (init_stage >= STAGE_TEMP_SAMPLER)
+    disksize_temp_sampler_stop();
+  if (init_stage >= STAGE_FRAGMENTATION)
+    disksize_fragmentation_stop();
+  if (init_stage >= STAGE_PAGE_CACHE)
+    disksize_page_cache_stop();
+  if (init_stage >= STAGE_DIR_USAGE)
+    disksize_dir_usage_stop();
+  if (init_stage >= STAGE_COLLECTOR)
+    disksize_collector_stop();
+  if (init_stage >= STAGE_PROBE_POOL)
+  {
+    disksize_shm_close();
+    disksize_probe_pool_stop();
+    cleanup_disksize_stats();
+  }
+  if (init_stage >= STAGE_HISTORY)
+    cleanup_disksize_history();
+  if (init_stage >= STAGE_STATUS_VARIABLES)
+    unregister_status_variables();
+  if (init_stage >= STAGE_SYSTEM_VARIABLES)
+    unregister_system_variables();
+  if (init_stage >= STAGE_TEMP_PEAKS)
+    cleanup_disksize_temp_peaks();
+  if (init_stage >= STAGE_LOG_USAGE)
+    cleanup_disksize_log_usage();
+  if (init_stage >= STAGE_THREAD_IO)
+    cleanup_disksize_thread_io();
+  if (init_stage >= STAGE_IO)
+    cleanup_disksize_io();
+  if (init_stage >= STAGE_DATA)
+  {
+    cleanup_disksize_data();
+    mysql_mutex_destroy(&LOCK_disksize_data);
+  }
+  init_stage = STAGE_NONE;
+}
+
 static mysql_service_status_t disksize_service_init()
 {
   mysql_service_status_t result = 0;
@@ -75,32 +719,110 @@ static mysql_service_status_t disksize_service_init()
 
   LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG, "initializing...");
   mysql_mutex_init(key_mutex_disksize_data, &LOCK_disksize_data, nullptr);
+  init_disksize_data();
+  init_stage = STAGE_DATA;
+  init_disksize_io();
+  init_stage = STAGE_IO;
+  init_disksize_thread_io();
+  init_stage = STAGE_THREAD_IO;
+  init_disksize_log_usage();
+  init_stage = STAGE_LOG_USAGE;
+  init_disksize_temp_peaks();
+  init_stage = STAGE_TEMP_PEAKS;
+
+  if (register_system_variables())
+    goto error;
+  init_stage = STAGE_SYSTEM_VARIABLES;
+
+  if (register_status_variables())
+    goto error;
+  init_stage = STAGE_STATUS_VARIABLES;
+
+  if (init_disksize_history())
+    goto error;
+  init_stage = STAGE_HISTORY;
+
+  if (disksize_probe_pool_start())
+    goto error;
+  init_stage = STAGE_PROBE_POOL;
+
+  disksize_shm_open();
+  if (disksize_collector_start())
+    goto error;
+  init_stage = STAGE_COLLECTOR;
+
+  if (disksize_dir_usage_start())
+    goto error;
+  init_stage = STAGE_DIR_USAGE;
+
+  if (disksize_page_cache_start())
+    goto error;
+  init_stage = STAGE_PAGE_CACHE;
+
+  if (disksize_fragmentation_start())
+    goto error;
+  init_stage = STAGE_FRAGMENTATION;
+
+  if (disksize_temp_sampler_start())
+    goto error;
+  init_stage = STAGE_TEMP_SAMPLER;
+
+  if (disksize_prometheus_start())
+    goto error;
+  init_stage = STAGE_PROMETHEUS;
+
+  if (disksize_canary_start())
+    goto error;
+  init_stage = STAGE_CANARY;
+
   init_disksize_share(&disksize_st_share);
+  init_disksize_history_share(&disksize_history_st_share);
+  init_disksize_dir_usage_share(&disksize_dir_usage_st_share);
+  init_disksize_stats_share(&disksize_stats_st_share);
+  init_disksize_histogram_share(&disksize_histogram_st_share);
+  init_disksize_io_share(&disksize_io_st_share);
+  init_disksize_page_cache_share(&disksize_page_cache_st_share);
+  init_disksize_fragmentation_share(&disksize_fragmentation_st_share);
+  init_disksize_log_usage_share(&disksize_log_usage_st_share);
+  init_disksize_temp_peak_share(&disksize_temp_peak_st_share);
+  init_disksize_canary_share(&disksize_canary_st_share);
+  init_disksize_thread_io_share(&disksize_thread_io_st_share);
   share_list[0] = &disksize_st_share;
+  share_list[1] = &disksize_history_st_share;
+  share_list[2] = &disksize_dir_usage_st_share;
+  share_list[3] = &disksize_stats_st_share;
+  share_list[4] = &disksize_histogram_st_share;
+  share_list[5] = &disksize_io_st_share;
+  share_list[6] = &disksize_page_cache_st_share;
+  share_list[7] = &disksize_fragmentation_st_share;
+  share_list[8] = &disksize_log_usage_st_share;
+  share_list[9] = &disksize_temp_peak_st_share;
+  share_list[10] = &disksize_canary_st_share;
+  share_list[11] = &disksize_thread_io_st_share;
   if (mysql_service_pfs_plugin_table_v1->add_tables(&share_list[0],
                                                     share_list_count))
   {
     LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
                     "PFS table has NOT been registered successfully!");
-    mysql_mutex_destroy(&LOCK_disksize_data);
-    return 1;
+    goto error;
   }
   else
   {
     LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG,
                     "PFS table has been registered successfully.");
   }
-  // We need to add the content in the table
 
   return result;
+
+error:
+  undo_init_stages();
+  return 1;
 }
 
 static mysql_service_status_t disksize_service_deinit()
 {
   mysql_service_status_t result = 0;
 
-  cleanup_disksize_data();
-
   if (mysql_service_pfs_plugin_table_v1->delete_tables(&share_list[0],
                                                        share_list_count))
   {
@@ -114,18 +836,25 @@ static mysql_service_status_t disksize_service_deinit()
                     "PFS table has been removed successfully.");
   }
 
-  LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG, "uninstalled.");
+  undo_init_stages();
 
-  mysql_mutex_destroy(&LOCK_disksize_data);
+  LogComponentErr(INFORMATION_LEVEL, ER_LOG_PRINTF_MSG, "uninstalled.");
 
   return result;
 }
 
+BEGIN_SERVICE_IMPLEMENTATION(disksize_service, disksize_query)
+disksize_query_imp::get_by_path,
+    disksize_query_imp::get_by_variable END_SERVICE_IMPLEMENTATION();
+
 BEGIN_COMPONENT_PROVIDES(disksize_service)
-END_COMPONENT_PROVIDES();
+PROVIDES_SERVICE(disksize_service, disksize_query),
+    END_COMPONENT_PROVIDES();
 
 BEGIN_COMPONENT_REQUIRES(disksize_service)
 REQUIRES_SERVICE(component_sys_variable_register),
+    REQUIRES_SERVICE(component_sys_variable_unregister),
+    REQUIRES_SERVICE(status_variable_registration),
     REQUIRES_SERVICE(log_builtins),
     REQUIRES_SERVICE(log_builtins_string),
     REQUIRES_SERVICE(mysql_thd_security_context),
@@ -136,6 +865,9 @@ REQUIRES_SERVICE(component_sys_variable_register),
     REQUIRES_SERVICE(pfs_plugin_table_v1),
     REQUIRES_SERVICE_AS(pfs_plugin_column_bigint_v1, pfs_bigint),
     REQUIRES_SERVICE_AS(pfs_plugin_column_string_v2, pfs_string),
+    REQUIRES_SERVICE_AS(pfs_plugin_column_timestamp_v2, pfs_timestamp),
+    REQUIRES_SERVICE_AS(pfs_plugin_column_enum_v1, pfs_enum),
+    REQUIRES_SERVICE_AS(pfs_plugin_column_double_v1, pfs_double),
     REQUIRES_PSI_MUTEX_SERVICE,
     REQUIRES_MYSQL_MUTEX_SERVICE,
     END_COMPONENT_REQUIRES();
@@ -26,12 +26,17 @@
 #define LOG_COMPONENT_TAG "disksize"
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <tuple>
+#include <atomic>
+#include <cstring>
+#include <memory>
 #include <mysql/components/component_implementation.h>
 #include <mysql/components/service_implementation.h>
 #include <mysql/components/services/pfs_plugin_table_service.h>
 #include <mysql/components/services/component_sys_var_service.h>
+#include <mysql/components/services/component_status_var_service.h>
 #include <mysql/components/services/mysql_current_thread_reader.h>
 #include <mysql/components/services/security_context.h>
 #include <mysql/components/services/mysql_runtime_error_service.h>
@@ -39,15 +44,19 @@
 #include <mysqld_error.h>                           /* Errors */
 #include <mysql/components/services/mysql_mutex.h>
 #include <mysql/components/services/psi_mutex.h>
+#include "components/disksize/disksize_publisher.h"
+#include "components/disksize/disksize_query.h"
+#include "components/disksize/disksize_shm.h"
+#include "components/disksize/disksize_stats.h"
 
 #ifndef _WIN32
 #include <sys/statvfs.h>
 #endif
 
 extern REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_register);
+extern REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_unregister);
 extern REQUIRES_SERVICE_PLACEHOLDER(log_builtins);
 extern REQUIRES_SERVICE_PLACEHOLDER(log_builtins_string);
-extern REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_register);
 
 extern REQUIRES_SERVICE_PLACEHOLDER(mysql_thd_security_context);
 extern REQUIRES_SERVICE_PLACEHOLDER(mysql_current_thread_reader);
@@ -59,6 +68,10 @@ extern REQUIRES_SERVICE_PLACEHOLDER(mysql_runtime_error);
 extern REQUIRES_SERVICE_PLACEHOLDER(pfs_plugin_table_v1);
 extern REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_bigint_v1, pfs_bigint);
 extern REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_string_v2, pfs_string);
+extern REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_timestamp_v2,
+                                       pfs_timestamp);
+extern REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_enum_v1, pfs_enum);
+extern REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_double_v1, pfs_double);
 
 extern REQUIRES_MYSQL_MUTEX_SERVICE_PLACEHOLDER;
 
@@ -70,29 +83,135 @@ extern SERVICE_TYPE(log_builtins_string) * log_bs;
 
 void init_disksize_data();
 void cleanup_disksize_data();
-extern void addDisksize_element(std::string disksize_dir_name, 
-                      std::string disksize_related_variable,
-                      PSI_ulonglong disksize_free_size,
-                      PSI_ulonglong disksize_total_size); 
 
 extern bool have_required_privilege(void *opaque_thd);
 
-int disksize_prepare_insert_row();
-
 /* Maximum number of rows in the table */
 #define DISKSIZE_MAX_ROWS  100
 
+/* Default number of seconds between two samples of the collector */
+#define DISKSIZE_DEFAULT_REFRESH_INTERVAL 5
+
+/* Default half-life, in seconds, of the samples used by the forecast */
+#define DISKSIZE_DEFAULT_FORECAST_HALF_LIFE 600
+
+/* disksize.refresh_interval system variable */
+extern unsigned int disksize_refresh_interval;
+
+/*
+  Default lower bound, in seconds, of the time between two samples of a
+  filesystem filling up or short of space
+*/
+#define DISKSIZE_DEFAULT_MIN_REFRESH_INTERVAL 1
+/* A filling filesystem is sampled at least this many times before full */
+#define DISKSIZE_SAMPLES_BEFORE_FULL 100
+/* Below this free percentage the interval shrinks with the free space */
+#define DISKSIZE_LOW_HEADROOM_PCT 10.0
+
+/* disksize.min_refresh_interval system variable */
+extern unsigned int disksize_min_refresh_interval;
+/* disksize.forecast_half_life system variable */
+extern unsigned int disksize_forecast_half_life;
+
 /* Global share pointer for pfs_example_disksize table */
 extern PFS_engine_table_share_proxy disksize_st_share;
 
-/* A structure to denote a single row of the table. */
+/* Values of enum('YES','NO'), enum values start at 1 */
+#define DISKSIZE_ENUM_YES 1ULL
+#define DISKSIZE_ENUM_NO 2ULL
+
+/* Byte sizes of the utf8mb4 string columns of the table definition */
+#define DISKSIZE_DIR_NAME_LENGTH (255 * 4)
+#define DISKSIZE_RELATED_VARIABLE_LENGTH (60 * 4)
+#define DISKSIZE_MOUNT_POINT_LENGTH (255 * 4)
+#define DISKSIZE_FS_TYPE_LENGTH (32 * 4)
+#define DISKSIZE_MOUNT_OPTIONS_LENGTH (255 * 4)
+
+/*
+  A bounded string stored inline, longer values are truncated before the
+  first UTF-8 character that does not fit entirely.
+*/
+template <size_t N>
+struct Disksize_string {
+  unsigned int m_length{0};
+  char m_data[N];
+
+  void set(std::string_view value) {
+    size_t length = value.size();
+    if (length > N) {
+      // value[length] must start a character, not continue one (10xxxxxx)
+      length = N;
+      while (length > 0 && (value[length] & 0xC0) == 0x80) length--;
+    }
+    m_length = (unsigned int)length;
+    memcpy(m_data, value.data(), m_length);
+  }
+
+  std::string_view view() const { return std::string_view(m_data, m_length); }
+};
+
+/*
+  A structure to denote a single row of the table.
+
+  Rows hold no pointer: a snapshot keeps all of them in one contiguous
+  allocation and the table reads the columns straight from there.
+*/
 struct Disksize_record {
-  std::string disksize_dir_name;
-  std::string disksize_related_variable;
   PSI_ubigint disksize_dir_size_free;
   PSI_ubigint disksize_dir_size_total;
+  /* Backing filesystem, rows sharing it come from a single statvfs() */
+  PSI_ubigint disksize_device_id;
+  /* Bytes consumed per second (negative when freed), NULL until 2 samples */
+  PSI_bigint disksize_fill_rate;
+  /* Projected time until the filesystem is full, NULL when not filling */
+  PSI_ubigint disksize_seconds_to_full;
+  Disksize_string<DISKSIZE_RELATED_VARIABLE_LENGTH> disksize_related_variable;
+  Disksize_string<DISKSIZE_DIR_NAME_LENGTH> disksize_dir_name;
+  Disksize_string<DISKSIZE_MOUNT_POINT_LENGTH> disksize_mount_point;
+  /* Empty when the path is not found in the mount table */
+  Disksize_string<DISKSIZE_FS_TYPE_LENGTH> disksize_fs_type;
+  Disksize_string<DISKSIZE_MOUNT_OPTIONS_LENGTH> disksize_mount_options;
+  /* When the values were read, older than the snapshot when stale */
+  unsigned long long disksize_sampled_at;
+  /* The probe did not answer in time, the last known values are shown */
+  bool disksize_is_stale;
 };
 
+/*
+  An immutable set of rows published by the collector.
+
+  Once published a snapshot is never modified: readers pin it with
+  disksize_snapshot_acquire() and unpin it with disksize_snapshot_release(),
+  only the collector frees it, after it has been replaced and unpinned.
+*/
+struct Disksize_snapshot {
+  /* Time of the sample, in microseconds since the epoch */
+  unsigned long long m_sampled_at{0};
+  std::vector<Disksize_record> m_rows;
+  /* Row numbers sorted on (DIR_NAME, RELATED_VARIABLE), the primary key */
+  std::vector<unsigned int> m_by_dir_name;
+  /* Row numbers sorted on RELATED_VARIABLE, the secondary key */
+  std::vector<unsigned int> m_by_related_variable;
+  /* Row numbers sorted on disksize_path_key(DIR_NAME), for the query service */
+  std::vector<unsigned int> m_by_path;
+  std::atomic<unsigned int> m_refs{0};
+
+  /*
+    The row was probed by the refresh that built this snapshot. Filesystems
+    not due on a partial refresh and stale ones keep older values.
+  */
+  bool is_fresh(const Disksize_record &record) const {
+    return !record.disksize_is_stale &&
+           record.disksize_sampled_at == m_sampled_at;
+  }
+};
+
+/* "/var/tmp/" and "/var/tmp" are the same directory */
+inline std::string_view disksize_path_key(std::string_view path) {
+  while (path.size() > 1 && path.back() == '/') path.remove_suffix(1);
+  return path;
+}
+
 class Disksize_POS {
  private:
   unsigned int m_index = 0;
@@ -112,21 +231,894 @@ class Disksize_POS {
   void set_after(Disksize_POS *pos) { m_index = pos->m_index + 1; }
 };
 
+/* Per open handle of a Disksize_snapshot_table */
+template <class Snapshot, class Record>
+struct Disksize_snapshot_table_handle {
+  /* Current position instance */
+  Disksize_POS m_pos;
+  /* Next position instance */
+  Disksize_POS m_next_pos;
+
+  /* Snapshot pinned when the table was opened, can be nullptr */
+  Snapshot *m_snapshot{nullptr};
+
+  /* Current row for the table, points into m_snapshot */
+  const Record *current_row{nullptr};
+
+  /* Added to disksize_rows_served when the table is closed */
+  unsigned long long m_rows_served{0};
+};
+
+/* Mirrors HA_READ_KEY_EXACT, the only find flag with a direct lookup */
+#define DISKSIZE_READ_KEY_EXACT 0
+
+struct Disksize_Table_Handle;
+
+/* Key values of the index in use, PRIMARY (0) or RELATED_VARIABLE (1) */
+struct Disksize_index {
+  Disksize_Table_Handle *m_handle;
+  PSI_plugin_key_string m_dir_name;
+  char m_dir_name_buffer[DISKSIZE_DIR_NAME_LENGTH];
+  PSI_plugin_key_string m_related_variable;
+  char m_related_variable_buffer[DISKSIZE_RELATED_VARIABLE_LENGTH];
+};
+
 struct Disksize_Table_Handle {
   /* Current position instance */
   Disksize_POS m_pos;
   /* Next position instance */
   Disksize_POS m_next_pos;
 
-  /* Current row for the table */
-  Disksize_record current_row;
+  /* Snapshot pinned when the table was opened, can be nullptr */
+  Disksize_snapshot *m_snapshot{nullptr};
+
+  /* Current row for the table, points into m_snapshot */
+  const Disksize_record *current_row{nullptr};
+
+  /* Added to disksize_rows_served when the table is closed */
+  unsigned long long m_rows_served{0};
 
   /* Index indicator */
   unsigned int index_num;
+
+  /* Index scan: key values and the range left to visit in the sorted rows */
+  Disksize_index m_index;
+  const std::vector<unsigned int> *m_index_rows{nullptr};
+  size_t m_index_cursor{0};
+  size_t m_index_end{0};
 };
 
 void init_disksize_share(PFS_engine_table_share_proxy *share);
 
+/*
+  Background collector (disksize_collector.cc)
+
+  A component owned thread samples all the monitored directories every
+  disksize.refresh_interval seconds and publishes the result as a snapshot.
+  The performance_schema table only pins that snapshot, it never calls
+  statvfs() itself and never takes a lock.
+*/
+bool disksize_collector_start();
+void disksize_collector_stop();
+void disksize_collector_wakeup();
+Disksize_snapshot *disksize_snapshot_acquire();
+void disksize_snapshot_release(Disksize_snapshot *snapshot);
+
+/*
+  disksize_query service (disksize_query.cc)
+
+  Lets other components read the last snapshot instead of calling
+  statvfs() themselves.
+*/
+class disksize_query_imp {
+ public:
+  static DEFINE_BOOL_METHOD(get_by_path,
+                            (const char *path, unsigned long long *free_bytes,
+                             unsigned long long *total_bytes, bool *is_stale));
+  static DEFINE_BOOL_METHOD(get_by_variable,
+                            (const char *variable,
+                             unsigned long long *free_bytes,
+                             unsigned long long *total_bytes, bool *is_stale));
+};
+
+/*
+  Shared memory snapshot (disksize_shm.cc)
+
+  When disksize.shm_path is set, the collector also copies every snapshot
+  to that file, see disksize_shm.h for its layout and the reader side.
+*/
+/* disksize.shm_path system variable */
+extern char *disksize_shm_path;
+
+void disksize_shm_open();
+/* Only called by the collector */
+void disksize_shm_write(const Disksize_snapshot *snapshot);
+void disksize_shm_close();
+
+/*
+  Low space alerts (disksize_alerts.cc)
+
+  Every filesystem probed by a refresh is checked against the warning and
+  critical watermarks: it goes to a level when its free space drops below
+  the watermark and leaves it once it is back above the watermark plus
+  disksize.alert_hysteresis_pct of its size.
+*/
+#define DISKSIZE_DEFAULT_WARNING_FREE_PCT 10
+#define DISKSIZE_DEFAULT_CRITICAL_FREE_PCT 5
+#define DISKSIZE_DEFAULT_ALERT_HYSTERESIS_PCT 2
+/* Seconds between two messages about the same filesystem */
+#define DISKSIZE_ALERT_LOG_INTERVAL 60
+
+#define DISKSIZE_ALERT_NONE 0
+#define DISKSIZE_ALERT_WARNING 1
+#define DISKSIZE_ALERT_CRITICAL 2
+
+/* disksize.warning_free_pct and disksize.critical_free_pct */
+extern unsigned int disksize_warning_free_pct;
+extern unsigned int disksize_critical_free_pct;
+/* disksize.warning_free_bytes and disksize.critical_free_bytes */
+extern unsigned long disksize_warning_free_bytes;
+extern unsigned long disksize_critical_free_bytes;
+/* disksize.alert_hysteresis_pct system variable */
+extern unsigned int disksize_alert_hysteresis_pct;
+/* disksize.watermarks system variable, the per variable watermarks */
+extern char *disksize_watermarks;
+
+/* Watermarks crossed downwards since the component was installed */
+extern std::atomic<unsigned long long> disksize_warning_alerts;
+extern std::atomic<unsigned long long> disksize_critical_alerts;
+/* Highest level among the monitored filesystems */
+extern std::atomic<unsigned int> disksize_alert_level;
+
+/* Only called by the collector, with every snapshot it builds */
+void disksize_alerts_check(const Disksize_snapshot *snapshot);
+
+/*
+  Prometheus textfile exporter (disksize_prometheus.cc)
+
+  When disksize.prometheus_dir is set, a thread renders the last snapshot
+  in the Prometheus text format every disksize.prometheus_interval seconds
+  and renames it over DISKSIZE_PROMETHEUS_FILE_NAME in that directory, for
+  the textfile collector of node_exporter.
+*/
+#define DISKSIZE_DEFAULT_PROMETHEUS_INTERVAL 15
+#define DISKSIZE_PROMETHEUS_FILE_NAME "mysql_disksize.prom"
+/* Initial size of the output buffer, grown once if it is too small */
+#define DISKSIZE_PROMETHEUS_BUFFER_SIZE (64 * 1024)
+
+/* disksize.prometheus_dir system variable */
+extern char *disksize_prometheus_dir;
+/* disksize.prometheus_interval system variable */
+extern unsigned int disksize_prometheus_interval;
+
+bool disksize_prometheus_start();
+void disksize_prometheus_stop();
+void disksize_prometheus_wakeup();
+
+/*
+  Server variables (disksize_variables.cc)
+
+  The values of variables_to_parse are read at every full refresh of the
+  collector and split into the monitored directories, only when they
+  changed since the previous read. Only used by the collector thread.
+*/
+extern std::vector<std::string> variables_to_parse;
+
+/*
+  Paths of one server variable: a single path, paths separated by ';', or
+  label:path pairs (innodb_redo_log_archive_dirs). They are parsed again
+  only when the raw value of the variable changes.
+*/
+struct Disksize_parsed_variable {
+  std::string raw_value;
+  bool parsed{false};
+  /* (RELATED_VARIABLE, DIR_NAME) */
+  std::vector<std::pair<std::string, std::string>> paths;
+};
+
+void disksize_refresh_parsed_variables();
+/* Same order as variables_to_parse */
+const std::vector<Disksize_parsed_variable> &disksize_parsed_variables();
+/* Last value read of a variable of variables_to_parse, empty if none */
+const std::string &disksize_parsed_raw_value(std::string_view variable);
+
+/*
+  Mount table (disksize_mounts.cc)
+
+  /proc/self/mountinfo is parsed once into a table sorted on the mount
+  point, and parsed again only when poll() on it reports a change. Only used
+  by the collector thread.
+*/
+struct Disksize_mount {
+  /* makedev() of the major:minor field, what stat() reports as st_dev */
+  unsigned long long m_device_id;
+  std::string m_mount_point;
+  std::string m_fs_type;
+  /* The per mount options followed by the superblock ones */
+  std::string m_options;
+};
+
+/* Reads the table again if it changed, true when it was read again */
+bool disksize_mounts_refresh();
+void disksize_mounts_close();
+/*
+  Mount of a device, nullptr if unknown. When the device is mounted on
+  several mount points, or not found, the longest mount point prefix of path,
+  an absolute path without symbolic links, decides. path may be empty.
+*/
+const Disksize_mount *disksize_mount_of(unsigned long long device_id,
+                                        std::string_view path);
+
+/*
+  Probe pool (disksize_probe.cc)
+
+  The system calls touching the monitored filesystems run on a small pool of
+  threads, the collector waits for them up to disksize.probe_timeout ms. A
+  probe blocked on a hung mount keeps its worker but never the collector.
+*/
+#define DISKSIZE_DEFAULT_PROBE_THREADS 4
+#define DISKSIZE_DEFAULT_PROBE_TIMEOUT 1000
+/* Workers started on top of disksize.probe_threads to replace stuck ones */
+#define DISKSIZE_MAX_EXTRA_PROBE_THREADS 32
+
+extern unsigned int disksize_probe_threads;
+extern unsigned int disksize_probe_timeout;
+
+class Disksize_probe {
+ public:
+  virtual ~Disksize_probe() = default;
+  /* Runs on a pool thread, can block */
+  virtual void run() = 0;
+
+  bool is_started() const { return m_started.load(std::memory_order_acquire); }
+  /* The results of run() can be read once this is true */
+  bool is_done() const { return m_done.load(std::memory_order_acquire); }
+
+  /* Only set by the pool */
+  std::atomic<bool> m_started{false};
+  std::atomic<bool> m_done{false};
+  /* Time spent in run(), in nanoseconds, valid once done */
+  unsigned long long m_latency{0};
+};
+
+bool disksize_probe_pool_start();
+void disksize_probe_pool_stop();
+/*
+  Run the probes and wait until they are all done or timeout_ms elapsed.
+  Probes still queued at the deadline are dropped, the ones running keep
+  running: check is_done() before reading their results.
+*/
+void disksize_probe_run(
+    const std::vector<std::shared_ptr<Disksize_probe>> &probes,
+    unsigned int timeout_ms);
+
+/*
+  disks_size_history (disksize_history.cc)
+
+  Every snapshot is appended to a ring preallocated at startup as one array
+  per column, its capacity is bounded by disksize.history_size entries and
+  disksize.history_max_memory bytes. Readers never lock: they validate each
+  entry after reading it and skip the ones overwritten meanwhile.
+*/
+#define DISKSIZE_DEFAULT_HISTORY_SIZE 36000
+#define DISKSIZE_DEFAULT_HISTORY_MAX_MEMORY (1024 * 1024)
+
+extern unsigned long disksize_history_size;
+extern unsigned long disksize_history_max_memory;
+
+/* (DIR_NAME, RELATED_VARIABLE) pair, stored once and referenced by entries */
+struct Disksize_history_name {
+  std::string m_dir_name;
+  std::string m_related_variable;
+};
+
+struct Disksize_history_entry {
+  unsigned long long m_sampled_at;
+  PSI_ubigint m_free;
+  PSI_ubigint m_total;
+  const Disksize_history_name *m_name;
+};
+
+class Disksize_history_POS {
+ private:
+  unsigned long long m_index = 0;
+
+ public:
+  ~Disksize_history_POS() = default;
+  Disksize_history_POS() { m_index = 0; }
+
+  unsigned long long get_index() { return m_index; }
+
+  void set_at(unsigned long long index) { m_index = index; }
+
+  void set_at(Disksize_history_POS *pos) { m_index = pos->m_index; }
+
+  void set_after(Disksize_history_POS *pos) { m_index = pos->m_index + 1; }
+};
+
+struct Disksize_history_Table_Handle {
+  /* Current position instance */
+  Disksize_history_POS m_pos;
+  /* Next position instance */
+  Disksize_history_POS m_next_pos;
+
+  /* Entries [m_begin, m_end) were in the ring when the table was opened */
+  unsigned long long m_begin{0};
+  unsigned long long m_end{0};
+
+  /* Current row for the table */
+  Disksize_history_entry current_row;
+
+  /* Added to disksize_rows_served when the table is closed */
+  unsigned long long m_rows_served{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_history_st_share;
+
+bool init_disksize_history();
+void cleanup_disksize_history();
+void disksize_history_add(const Disksize_snapshot *snapshot);
+void init_disksize_history_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disks_usage_by_dir (disksize_dir_usage.cc)
+
+  A background thread walks the monitored directories every
+  disksize.dir_usage_interval seconds with disksize.dir_usage_threads
+  work-stealing workers, and publishes the space used by each directory.
+*/
+#define DISKSIZE_DEFAULT_DIR_USAGE_INTERVAL 300
+#define DISKSIZE_DEFAULT_DIR_USAGE_THREADS 4
+/* One pass out of this many re-stats every file, even in unchanged dirs */
+#define DISKSIZE_DIR_USAGE_FULL_SCAN_PASSES 10
+/* Maximum number of directories walked in one pass */
+#define DISKSIZE_DIR_USAGE_MAX_DIRS 100000
+
+extern unsigned int disksize_dir_usage_interval;
+extern unsigned int disksize_dir_usage_threads;
+
+struct Disksize_dir_usage_record {
+  std::string m_dir_name;
+  std::string m_related_variable;
+  /* Regular files directly in the directory */
+  PSI_ubigint m_file_count;
+  PSI_ubigint m_size;
+  PSI_ubigint m_allocated_size;
+  /* Logical size of the directory and all its subdirectories */
+  PSI_ubigint m_total_size;
+};
+
+struct Disksize_dir_usage_snapshot {
+  std::vector<Disksize_dir_usage_record> m_rows;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_dir_usage_st_share;
+
+bool disksize_dir_usage_start();
+void disksize_dir_usage_stop();
+void disksize_dir_usage_wakeup();
+void init_disksize_dir_usage_share(PFS_engine_table_share_proxy *share);
+
+struct Disksize_monitored_dir {
+  std::string m_dir_name;
+  std::string m_related_variable;
+};
+
+/* The directories the file level tables look into */
+void disksize_monitored_dirs(std::vector<Disksize_monitored_dir> *dirs);
+
+/*
+  disks_page_cache (disksize_page_cache.cc)
+
+  A background thread maps the files of the monitored directories read-only
+  every disksize.page_cache_interval seconds and asks mincore() which of
+  their pages are in the OS page cache. No page is read, so nothing gets
+  evicted, and the scan is throttled to disksize.page_cache_scan_rate MiB
+  of file per second.
+*/
+#define DISKSIZE_DEFAULT_PAGE_CACHE_INTERVAL 600
+#define DISKSIZE_DEFAULT_PAGE_CACHE_SCAN_RATE 1024
+/* Bytes of a file mapped and checked by one mincore() call */
+#define DISKSIZE_PAGE_CACHE_CHUNK (64 * 1024 * 1024)
+/* Maximum number of files checked in one pass */
+#define DISKSIZE_PAGE_CACHE_MAX_FILES 100000
+
+extern unsigned int disksize_page_cache_interval;
+extern unsigned int disksize_page_cache_scan_rate;
+
+struct Disksize_page_cache_record {
+  /* Path of the file, or of the directory for its total */
+  std::string m_name;
+  std::string m_related_variable;
+  /* Value of the OBJECT_TYPE enum */
+  unsigned long long m_type;
+  PSI_ubigint m_size;
+  PSI_ubigint m_resident_size;
+  PSI_double m_resident_pct;
+};
+
+struct Disksize_page_cache_snapshot {
+  std::vector<Disksize_page_cache_record> m_rows;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_page_cache_st_share;
+
+bool disksize_page_cache_start();
+void disksize_page_cache_stop();
+void disksize_page_cache_wakeup();
+void init_disksize_page_cache_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disks_fragmentation (disksize_fragmentation.cc)
+
+  A background thread lists the extents of the files of the monitored
+  directories with the FS_IOC_FIEMAP ioctl every
+  disksize.fragmentation_interval seconds, throttled to
+  disksize.fragmentation_scan_rate ioctls per second. Files whose size and
+  mtime did not change since the previous pass are not mapped again.
+*/
+#define DISKSIZE_DEFAULT_FRAGMENTATION_INTERVAL 3600
+#define DISKSIZE_DEFAULT_FRAGMENTATION_SCAN_RATE 1000
+/* Extents returned by one ioctl */
+#define DISKSIZE_FIEMAP_BATCH 256
+/* Maximum number of files mapped in one pass */
+#define DISKSIZE_FRAGMENTATION_MAX_FILES 100000
+
+extern unsigned int disksize_fragmentation_interval;
+extern unsigned int disksize_fragmentation_scan_rate;
+
+struct Disksize_fragmentation_record {
+  std::string m_file_name;
+  std::string m_related_variable;
+  /* NULL when the filesystem does not support FIEMAP */
+  PSI_ubigint m_extent_count;
+  PSI_ubigint m_avg_extent_size;
+  PSI_ubigint m_logical_size;
+  PSI_ubigint m_allocated_size;
+  /* Holes: logical bytes not allocated (punched pages, sparse files) */
+  PSI_ubigint m_sparse_size;
+};
+
+struct Disksize_fragmentation_snapshot {
+  std::vector<Disksize_fragmentation_record> m_rows;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_fragmentation_st_share;
+
+bool disksize_fragmentation_start();
+void disksize_fragmentation_stop();
+void disksize_fragmentation_wakeup();
+void init_disksize_fragmentation_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disks_log_usage (disksize_log_usage.cc)
+
+  The binary logs, relay logs and redo log files are tracked by the
+  collector in one index per log, ordered by sequence number. Between two
+  full listings only the newest file is stat'ed again, the next sequence
+  numbers are probed for new files and the oldest ones for purged files.
+  Each index is refreshed by a probe of the probe pool: a log on a hung
+  mount keeps its last rows, flagged as stale.
+*/
+/* One refresh out of this many lists the log directories again */
+#define DISKSIZE_LOG_USAGE_FULL_SCAN_PASSES 60
+/* Maximum number of files tracked per log */
+#define DISKSIZE_LOG_USAGE_MAX_FILES 100000
+#define DISKSIZE_LOG_FILE_NAME_LENGTH (255 * 4)
+
+/* Where the collector found the logs, empty when a log is disabled */
+struct Disksize_log_sources {
+  std::string m_binlog_basename;
+  std::string m_relay_log_basename;
+  std::string m_redo_home_dir;
+};
+
+struct Disksize_log_usage_record {
+  /* Value of the LOG_TYPE enum */
+  unsigned long long m_type;
+  std::string m_dir_name;
+  std::string m_file_name;
+  unsigned long long m_sequence;
+  unsigned long long m_size;
+  /* Bytes in the older files of the same log, what a purge up to it frees */
+  unsigned long long m_bytes_before;
+  /* Bytes written per second, on the newest file of each log only */
+  PSI_double m_growth_rate;
+  /* The directory did not answer in time, the last known rows are shown */
+  bool m_is_stale;
+};
+
+struct Disksize_log_usage_snapshot {
+  std::vector<Disksize_log_usage_record> m_rows;
+  /* Row numbers sorted on FILE_NAME */
+  std::vector<unsigned int> m_by_file_name;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+struct Disksize_log_usage_Table_Handle;
+
+/* Key values of KEY(FILE_NAME) */
+struct Disksize_log_usage_index {
+  Disksize_log_usage_Table_Handle *m_handle;
+  PSI_plugin_key_string m_file_name;
+  char m_file_name_buffer[DISKSIZE_LOG_FILE_NAME_LENGTH];
+};
+
+struct Disksize_log_usage_Table_Handle
+    : Disksize_snapshot_table_handle<Disksize_log_usage_snapshot,
+                                     Disksize_log_usage_record> {
+  /* Index scan: key value and the range left to visit in m_by_file_name */
+  Disksize_log_usage_index m_index;
+  size_t m_index_cursor{0};
+  size_t m_index_end{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_log_usage_st_share;
+
+void init_disksize_log_usage();
+void cleanup_disksize_log_usage();
+/* Only called by the collector */
+void disksize_log_usage_refresh(const Disksize_log_sources &sources);
+void init_disksize_log_usage_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disks_temp_peaks (disksize_temp_peaks.cc)
+
+  Sorts, ALTER TABLE and temporary tables can fill a temporary directory
+  and free it again between two refreshes of the collector. When
+  disksize.temp_sample_interval is set, a sampler thread calls statvfs()
+  on the filesystems of the temporary directories every that many
+  milliseconds, through the probe pool, and pushes the samples into a
+  single producer, single consumer ring. The collector drains it at each refresh and keeps the
+  peak usage of every disksize.temp_peak_window seconds.
+*/
+#define DISKSIZE_DEFAULT_TEMP_SAMPLE_INTERVAL 0
+/* Lower nonzero values of disksize.temp_sample_interval are raised to it */
+#define DISKSIZE_MIN_TEMP_SAMPLE_INTERVAL 10
+#define DISKSIZE_DEFAULT_TEMP_PEAK_WINDOW 10
+/* Windows kept per filesystem */
+#define DISKSIZE_TEMP_PEAK_WINDOWS 60
+/* Samples the ring holds, a power of 2 */
+#define DISKSIZE_TEMP_RING_SIZE 4096
+
+extern unsigned int disksize_temp_sample_interval;
+extern unsigned int disksize_temp_peak_window;
+
+struct Disksize_temp_peak_record {
+  std::string m_related_variable;
+  std::string m_dir_name;
+  unsigned long long m_device_id;
+  /* Microseconds since the epoch */
+  unsigned long long m_window_start;
+  unsigned long long m_sample_count;
+  unsigned long long m_size;
+  unsigned long long m_min_used;
+  unsigned long long m_peak_used;
+  unsigned long long m_peak_at;
+};
+
+struct Disksize_temp_peak_snapshot {
+  std::vector<Disksize_temp_peak_record> m_rows;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_temp_peak_st_share;
+
+void init_disksize_temp_peaks();
+void cleanup_disksize_temp_peaks();
+bool disksize_temp_sampler_start();
+void disksize_temp_sampler_stop();
+void disksize_temp_sampler_wakeup();
+/* Only called by the collector, with the snapshot it is about to publish */
+void disksize_temp_peaks_collect(const Disksize_snapshot *snapshot);
+void init_disksize_temp_peak_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disks_latency (disksize_canary.cc)
+
+  Opt-in active probe of the monitored filesystems: every
+  disksize.canary_interval seconds a thread writes one aligned block with
+  O_DIRECT to a preallocated canary file on each filesystem, syncs it with
+  fdatasync() and reads it back. One block per filesystem and per interval
+  is all the I/O it ever issues.
+
+  The I/O runs in the probe pool, all filesystems at once: an operation
+  still running after DISKSIZE_CANARY_TIMEOUT ms is counted as a timeout,
+  and that filesystem is not probed again until it returns.
+*/
+#define DISKSIZE_DEFAULT_CANARY_INTERVAL 0
+#define DISKSIZE_CANARY_FILE_NAME "#disksize_canary"
+/* Size and alignment of the block, fits the logical sectors of any disk */
+#define DISKSIZE_CANARY_BLOCK_SIZE 4096
+/* Filesystems probed at most */
+#define DISKSIZE_CANARY_MAX_FILESYSTEMS 32
+/* Milliseconds the thread waits for the I/O of a pass */
+#define DISKSIZE_CANARY_TIMEOUT 5000
+
+/* disksize.canary_interval system variable */
+extern unsigned int disksize_canary_interval;
+
+struct Disksize_canary_record {
+  unsigned long long m_device_id;
+  /* Directory holding the canary file */
+  std::string m_dir_name;
+  /* Value of the OPERATION enum */
+  unsigned long long m_operation;
+  unsigned long long m_count;
+  unsigned long long m_errors;
+  unsigned long long m_timeouts;
+  /* Nanoseconds */
+  unsigned long long m_p50;
+  unsigned long long m_p99;
+  unsigned long long m_max;
+  unsigned long long m_last;
+};
+
+struct Disksize_canary_snapshot {
+  std::vector<Disksize_canary_record> m_rows;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_canary_st_share;
+
+bool disksize_canary_start();
+void disksize_canary_stop();
+void disksize_canary_wakeup();
+void init_disksize_canary_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disks_io (disksize_io.cc)
+
+  Every refresh, the collector reads /proc/diskstats once and keeps the
+  counters of the block devices backing the monitored paths. The table shows
+  the rates between the last two samples.
+*/
+#define DISKSIZE_DEVICE_NAME_LENGTH (32 * 4)
+
+struct Disksize_io_record {
+  Disksize_string<DISKSIZE_DEVICE_NAME_LENGTH> m_device_name;
+  PSI_ubigint m_device_id;
+  /* NULL until two samples of the device have been taken */
+  PSI_double m_read_iops;
+  PSI_double m_write_iops;
+  PSI_double m_read_bytes_per_sec;
+  PSI_double m_write_bytes_per_sec;
+  /* Milliseconds per completed request, queueing included */
+  PSI_double m_avg_service_time;
+  /* Percentage of the interval the device had requests in flight */
+  PSI_double m_utilization;
+  PSI_ubigint m_in_flight;
+  unsigned long long m_sampled_at;
+};
+
+struct Disksize_io_snapshot {
+  std::vector<Disksize_io_record> m_rows;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_io_st_share;
+
+void init_disksize_io();
+void cleanup_disksize_io();
+/* Only called by the collector, with the devices of its last snapshot */
+void disksize_io_sample(const Disksize_snapshot *snapshot);
+void init_disksize_io_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disks_thread_io (disksize_thread_io.cc)
+
+  Every full refresh, the collector reads /proc/self/task/<tid>/io of the
+  threads of mysqld. Only the threads which read or wrote since the previous
+  sample have a row, THREAD_OS_ID joins performance_schema.threads.
+*/
+struct Disksize_thread_io_record {
+  unsigned long long m_thread_os_id;
+  unsigned long long m_read_bytes;
+  unsigned long long m_write_bytes;
+  unsigned long long m_cancelled_write_bytes;
+  /* NULL for a thread seen for the first time */
+  PSI_double m_read_bytes_per_sec;
+  PSI_double m_write_bytes_per_sec;
+  PSI_double m_cancelled_write_bytes_per_sec;
+  unsigned long long m_sampled_at;
+};
+
+struct Disksize_thread_io_snapshot {
+  std::vector<Disksize_thread_io_record> m_rows;
+  std::atomic<unsigned int> m_refs{0};
+};
+
+extern PFS_engine_table_share_proxy disksize_thread_io_st_share;
+
+void init_disksize_thread_io();
+void cleanup_disksize_thread_io();
+/* Only called by the collector, sampled_at is the time of its snapshot */
+void disksize_thread_io_sample(unsigned long long sampled_at);
+void init_disksize_thread_io_share(PFS_engine_table_share_proxy *share);
+
+/*
+  disksize_collector_stats and disksize_collector_histogram (disksize_stats.cc)
+
+  Probe latencies of each monitored path and filesystem, and the global
+  counters of the component. Entries are created by the collector only and
+  are never removed while the component is installed.
+*/
+struct Disksize_probe_stats {
+  /* Set before the entry is visible, then never changed */
+  std::string m_name;
+  Disksize_timer_stats m_latency;
+  std::atomic<unsigned long long> m_errors{0};
+  std::atomic<unsigned long long> m_timeouts{0};
+};
+
+extern Disksize_timer_stats disksize_refresh_stats;
+extern std::atomic<unsigned long long> disksize_table_opens;
+extern std::atomic<unsigned long long> disksize_rows_served;
+
+/* Only called by the collector, nullptr when DISKSIZE_MAX_ROWS are tracked */
+Disksize_probe_stats *disksize_path_stats(const std::string &path);
+Disksize_probe_stats *disksize_filesystem_stats(unsigned long long device_id,
+                                                const std::string &name);
+void cleanup_disksize_stats();
+
+/* Account for a table handle being opened and the rows it returned */
+inline void disksize_count_table_open() {
+  disksize_table_opens.fetch_add(1, std::memory_order_relaxed);
+}
+inline void disksize_count_rows_served(unsigned long long rows) {
+  disksize_rows_served.fetch_add(rows, std::memory_order_relaxed);
+}
+
+/*
+  The table functions of a read only table showing Snapshot::m_rows, the
+  snapshot being pinned from a Disksize_publisher when the table is opened.
+  A module only provides the columns of a row and its table definition.
+  Handle can extend Disksize_snapshot_table_handle for an index scan.
+*/
+template <class Snapshot, class Record,
+          class Handle = Disksize_snapshot_table_handle<Snapshot, Record>>
+class Disksize_snapshot_table {
+ public:
+  typedef void (*Read_column)(const Record &row, PSI_field *field,
+                              unsigned int index);
+
+  /* Everything but the name and the definition of the table */
+  template <Disksize_publisher<Snapshot> *publisher, Read_column read_column>
+  static void init_share(PFS_engine_table_share_proxy *share) {
+    share->m_ref_length = sizeof(Disksize_POS);
+    share->m_acl = READONLY;
+    share->get_row_count = get_row_count<publisher>;
+    share->delete_all_rows = nullptr; /* READONLY TABLE */
+
+    share->m_proxy_engine_table = {
+        rnd_next, rnd_init, rnd_pos,
+        nullptr, nullptr, nullptr,
+        read_column_value<read_column>, reset_position,
+        /* READONLY TABLE */
+        nullptr, /* write_column_value */
+        nullptr, /* write_row_values */
+        nullptr, /* update_column_value */
+        nullptr, /* update_row_values */
+        nullptr, /* delete_row_values */
+        open_table<publisher>, close_table<publisher>};
+  }
+
+ private:
+  template <Disksize_publisher<Snapshot> *publisher>
+  static PSI_table_handle *open_table(PSI_pos **pos) {
+    MYSQL_THD thd;
+    Handle *temp = new Handle();
+
+    disksize_count_table_open();
+    mysql_service_mysql_current_thread_reader->get(&thd);
+    if (!have_required_privilege(thd))
+      mysql_error_service_printf(ER_SPECIFIC_ACCESS_DENIED_ERROR, 0,
+                                 PRIVILEGE_NAME);
+    else
+      temp->m_snapshot = publisher->acquire();
+
+    *pos = (PSI_pos *)(&temp->m_pos);
+
+    return (PSI_table_handle *)temp;
+  }
+
+  template <Disksize_publisher<Snapshot> *publisher>
+  static void close_table(PSI_table_handle *handle) {
+    Handle *temp = (Handle *)handle;
+    disksize_count_rows_served(temp->m_rows_served);
+    publisher->release(temp->m_snapshot);
+    delete temp;
+  }
+
+  static int rnd_next(PSI_table_handle *handle) {
+    Handle *h = (Handle *)handle;
+    h->m_pos.set_at(&h->m_next_pos);
+    size_t index = h->m_pos.get_index();
+
+    if (h->m_snapshot != nullptr && index < h->m_snapshot->m_rows.size()) {
+      h->current_row = &h->m_snapshot->m_rows[index];
+      h->m_next_pos.set_after(&h->m_pos);
+      h->m_rows_served++;
+      return 0;
+    }
+
+    return PFS_HA_ERR_END_OF_FILE;
+  }
+
+  static int rnd_init(PSI_table_handle *, bool) { return 0; }
+
+  static int rnd_pos(PSI_table_handle *handle) {
+    Handle *h = (Handle *)handle;
+    size_t index = h->m_pos.get_index();
+
+    if (h->m_snapshot != nullptr && index < h->m_snapshot->m_rows.size())
+      h->current_row = &h->m_snapshot->m_rows[index];
+
+    return 0;
+  }
+
+  static void reset_position(PSI_table_handle *handle) {
+    Handle *h = (Handle *)handle;
+    h->m_pos.reset();
+    h->m_next_pos.reset();
+    h->current_row = nullptr;
+  }
+
+  template <Read_column read_column>
+  static int read_column_value(PSI_table_handle *handle, PSI_field *field,
+                               unsigned int index) {
+    Handle *h = (Handle *)handle;
+
+    if (h->current_row != nullptr) read_column(*h->current_row, field, index);
+    return 0;
+  }
+
+  template <Disksize_publisher<Snapshot> *publisher>
+  static unsigned long long get_row_count(void) {
+    Snapshot *snapshot = publisher->acquire();
+    unsigned long long count =
+        (snapshot != nullptr) ? snapshot->m_rows.size() : 0;
+    publisher->release(snapshot);
+    return count;
+  }
+};
+
+struct Disksize_stats_row {
+  /* Value of the OBJECT_TYPE enum */
+  unsigned long long m_type{0};
+  std::string_view m_name;
+  /* Either a timer, or a plain counter for the GLOBAL rows */
+  const Disksize_timer_stats *m_timer{nullptr};
+  const std::atomic<unsigned long long> *m_counter{nullptr};
+  /* PATH and FILESYSTEM rows only */
+  const Disksize_probe_stats *m_probe{nullptr};
+  /* disksize_collector_histogram only */
+  unsigned int m_bucket{0};
+};
+
+struct Disksize_stats_Table_Handle {
+  /* Current position instance */
+  Disksize_POS m_pos;
+  /* Next position instance */
+  Disksize_POS m_next_pos;
+
+  /* Objects visible when the table was opened, 0 when not allowed */
+  unsigned int m_object_count{0};
+  unsigned int m_path_count{0};
+
+  /* Current row for the table */
+  Disksize_stats_row current_row;
+};
+
+extern PFS_engine_table_share_proxy disksize_stats_st_share;
+extern PFS_engine_table_share_proxy disksize_histogram_st_share;
+
+void init_disksize_stats_share(PFS_engine_table_share_proxy *share);
+void init_disksize_histogram_share(PFS_engine_table_share_proxy *share);
+
 extern PFS_engine_table_share_proxy disksize_st_share;
 
 extern PFS_engine_table_share_proxy *share_list[];
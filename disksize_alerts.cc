@@ -0,0 +1,304 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <map>
+#include <set>
+
+unsigned int disksize_warning_free_pct = DISKSIZE_DEFAULT_WARNING_FREE_PCT;
+unsigned int disksize_critical_free_pct = DISKSIZE_DEFAULT_CRITICAL_FREE_PCT;
+unsigned long disksize_warning_free_bytes = 0;
+unsigned long disksize_critical_free_bytes = 0;
+unsigned int disksize_alert_hysteresis_pct =
+    DISKSIZE_DEFAULT_ALERT_HYSTERESIS_PCT;
+char *disksize_watermarks = nullptr;
+
+std::atomic<unsigned long long> disksize_warning_alerts{0};
+std::atomic<unsigned long long> disksize_critical_alerts{0};
+std::atomic<unsigned int> disksize_alert_level{DISKSIZE_ALERT_NONE};
+
+/*
+  DATA, only used by the collector
+*/
+
+/* Either a percentage of the filesystem or a number of bytes */
+struct Disksize_watermark {
+  unsigned long long bytes{0};
+  double pct{0};
+};
+
+struct Disksize_watermarks {
+  Disksize_watermark warning;
+  Disksize_watermark critical;
+};
+
+/* disksize.watermarks, parsed once as the variable is read only */
+static std::map<std::string, Disksize_watermarks, std::less<>>
+    variable_watermarks;
+static bool watermarks_parsed = false;
+
+struct Disksize_alert_state {
+  unsigned int level{DISKSIZE_ALERT_NONE};
+  /* Level of the last message, and when it was written */
+  unsigned int logged_level{DISKSIZE_ALERT_NONE};
+  unsigned long long logged_at{0};
+  /* Snapshot the filesystem was last seen in, to forget the removed ones */
+  unsigned long long pass{0};
+};
+
+/* Keyed on DEVICE_ID: one alert per filesystem, whatever its rows */
+static std::map<unsigned long long, Disksize_alert_state> alert_states;
+static unsigned long long alert_pass = 0;
+
+/* The fresh rows of one filesystem in a snapshot */
+struct Disksize_alert_device {
+  const Disksize_record *row{nullptr};
+  /* The strictest watermarks among its variables, in bytes */
+  double warning{0};
+  double critical{0};
+  std::set<std::string_view> variables;
+};
+
+/* "20%", "512M", "10G" or a number of bytes, true on error */
+static bool parse_watermark(std::string_view text, Disksize_watermark *mark)
+{
+  double value = 0;
+  const char *end = text.data() + text.size();
+  auto parsed = std::from_chars(text.data(), end, value);
+  if (parsed.ec != std::errc() || value < 0)
+    return true;
+
+  std::string_view suffix(parsed.ptr, end - parsed.ptr);
+  double multiplier = 1;
+  if (suffix == "%")
+  {
+    mark->pct = std::min(value, 100.0);
+    return false;
+  }
+  if (suffix == "K" || suffix == "k")
+    multiplier = 1024.0;
+  else if (suffix == "M" || suffix == "m")
+    multiplier = 1024.0 * 1024;
+  else if (suffix == "G" || suffix == "g")
+    multiplier = 1024.0 * 1024 * 1024;
+  else if (suffix == "T" || suffix == "t")
+    multiplier = 1024.0 * 1024 * 1024 * 1024;
+  else if (!suffix.empty())
+    return true;
+  mark->bytes = (unsigned long long)(value * multiplier);
+  return false;
+}
+
+/*
+  disksize.watermarks is a comma separated list of
+  RELATED_VARIABLE=WARNING/CRITICAL, each watermark being a percentage or a
+  size, for example "tmpdir=20%/10%,log_bin_basename=50G/10G". A malformed
+  entry is skipped with a warning.
+*/
+static void parse_variable_watermarks()
+{
+  watermarks_parsed = true;
+  if (disksize_watermarks == nullptr)
+    return;
+
+  std::string_view remaining(disksize_watermarks);
+  while (!remaining.empty())
+  {
+    size_t comma = remaining.find(',');
+    std::string_view entry = remaining.substr(0, comma);
+    remaining.remove_prefix(comma == std::string_view::npos ? remaining.size()
+                                                            : comma + 1);
+    if (entry.empty())
+      continue;
+
+    size_t equal = entry.find('=');
+    size_t slash = entry.find('/');
+    Disksize_watermarks marks;
+    if (equal == std::string_view::npos || slash == std::string_view::npos ||
+        slash < equal || equal == 0 ||
+        parse_watermark(entry.substr(equal + 1, slash - equal - 1),
+                        &marks.warning) ||
+        parse_watermark(entry.substr(slash + 1), &marks.critical))
+    {
+      char msgbuf[1024];
+      snprintf(msgbuf, sizeof(msgbuf),
+               "Ignoring the malformed disksize.watermarks entry '%.*s'",
+               (int)entry.size(), entry.data());
+      LogComponentErr(WARNING_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+      continue;
+    }
+    variable_watermarks[std::string(entry.substr(0, equal))] = marks;
+  }
+}
+
+static Disksize_watermarks watermarks_of(std::string_view variable)
+{
+  auto found = variable_watermarks.find(variable);
+  if (found != variable_watermarks.end())
+    return found->second;
+
+  Disksize_watermarks marks;
+  marks.warning.bytes = disksize_warning_free_bytes;
+  marks.warning.pct = disksize_warning_free_pct;
+  marks.critical.bytes = disksize_critical_free_bytes;
+  marks.critical.pct = disksize_critical_free_pct;
+  return marks;
+}
+
+/* The higher of the two limits, 0 when the watermark is disabled */
+static double threshold_of(const Disksize_watermark &mark, double total)
+{
+  return std::max((double)mark.bytes, total * mark.pct / 100.0);
+}
+
+static const char *level_name(unsigned int level)
+{
+  return level == DISKSIZE_ALERT_CRITICAL ? "critical" : "warning";
+}
+
+static void log_alert(const Disksize_alert_device &device,
+                      unsigned int level, unsigned int previous_level)
+{
+  char msgbuf[1024];
+  const Disksize_record &row = *device.row;
+  unsigned long long free_bytes = row.disksize_dir_size_free.val;
+  unsigned long long total_bytes = row.disksize_dir_size_total.val;
+  std::string_view mount_point = row.disksize_mount_point.view();
+  std::string variables;
+  for (std::string_view variable : device.variables)
+  {
+    if (!variables.empty())
+      variables += ", ";
+    variables += variable;
+  }
+
+  if (level > previous_level)
+    snprintf(msgbuf, sizeof(msgbuf),
+             "Free space of %.*s (%s) is below the %s watermark: %llu bytes "
+             "free of %llu (%.1f%%)",
+             (int)mount_point.size(), mount_point.data(),
+             variables.c_str(), level_name(level), free_bytes,
+             total_bytes, 100.0 * free_bytes / total_bytes);
+  else
+    snprintf(msgbuf, sizeof(msgbuf),
+             "Free space of %.*s (%s) is back above the %s watermark: %llu "
+             "bytes free of %llu (%.1f%%)",
+             (int)mount_point.size(), mount_point.data(),
+             variables.c_str(), level_name(previous_level), free_bytes,
+             total_bytes, 100.0 * free_bytes / total_bytes);
+
+  LogComponentErr(level == DISKSIZE_ALERT_CRITICAL  ? ERROR_LEVEL
+                  : level == DISKSIZE_ALERT_WARNING ? WARNING_LEVEL
+                                                    : INFORMATION_LEVEL,
+                  ER_LOG_PRINTF_MSG, msgbuf);
+}
+
+/*
+  The rows of a filesystem share its free space, they are checked together
+  against the highest watermarks of their variables, and a change of level
+  is one message listing them. Only the filesystems probed by this refresh
+  are checked, the others keep their level.
+
+  A change of level is counted at once, but logged at most every
+  DISKSIZE_ALERT_LOG_INTERVAL seconds per filesystem: a message held back
+  is written at the first check after that delay if the level is still
+  different from the last one logged.
+*/
+void disksize_alerts_check(const Disksize_snapshot *snapshot)
+{
+  if (!watermarks_parsed)
+    parse_variable_watermarks();
+
+  unsigned long long now = disksize_now_ns();
+  unsigned int highest_level = DISKSIZE_ALERT_NONE;
+  std::map<unsigned long long, Disksize_alert_device> devices;
+  alert_pass++;
+
+  for (const Disksize_record &row : snapshot->m_rows)
+  {
+    unsigned long long device_id = row.disksize_device_id.val;
+    alert_states[device_id].pass = alert_pass;
+    if (!snapshot->is_fresh(row) || row.disksize_dir_size_total.val == 0)
+      continue;
+
+    Disksize_alert_device &device = devices[device_id];
+    double total = (double)row.disksize_dir_size_total.val;
+    Disksize_watermarks marks =
+        watermarks_of(row.disksize_related_variable.view());
+    device.row = &row;
+    device.warning =
+        std::max(device.warning, threshold_of(marks.warning, total));
+    device.critical =
+        std::max(device.critical, threshold_of(marks.critical, total));
+    device.variables.insert(row.disksize_related_variable.view());
+  }
+
+  for (const auto &entry : devices)
+  {
+    const Disksize_alert_device &device = entry.second;
+    Disksize_alert_state &state = alert_states[entry.first];
+    double total = (double)device.row->disksize_dir_size_total.val;
+    double free_bytes = (double)device.row->disksize_dir_size_free.val;
+    double margin = total * disksize_alert_hysteresis_pct / 100.0;
+
+    unsigned int level = DISKSIZE_ALERT_NONE;
+    if (free_bytes < device.critical ||
+        (state.level == DISKSIZE_ALERT_CRITICAL &&
+         free_bytes < device.critical + margin))
+      level = DISKSIZE_ALERT_CRITICAL;
+    else if (free_bytes < device.warning ||
+             (state.level >= DISKSIZE_ALERT_WARNING &&
+              free_bytes < device.warning + margin))
+      level = DISKSIZE_ALERT_WARNING;
+
+    if (level >= DISKSIZE_ALERT_WARNING && state.level < DISKSIZE_ALERT_WARNING)
+      disksize_warning_alerts.fetch_add(1, std::memory_order_relaxed);
+    if (level == DISKSIZE_ALERT_CRITICAL &&
+        state.level < DISKSIZE_ALERT_CRITICAL)
+      disksize_critical_alerts.fetch_add(1, std::memory_order_relaxed);
+    state.level = level;
+
+    if (state.level != state.logged_level &&
+        (state.logged_at == 0 ||
+         now - state.logged_at >= DISKSIZE_ALERT_LOG_INTERVAL * 1000000000ULL))
+    {
+      log_alert(device, state.level, state.logged_level);
+      state.logged_level = state.level;
+      state.logged_at = now;
+    }
+  }
+
+  // Filesystems not monitored anymore are forgotten
+  for (auto it = alert_states.begin(); it != alert_states.end();)
+  {
+    if (it->second.pass != alert_pass)
+      it = alert_states.erase(it);
+    else
+    {
+      highest_level = std::max(highest_level, it->second.level);
+      ++it;
+    }
+  }
+
+  disksize_alert_level.store(highest_level, std::memory_order_relaxed);
+}
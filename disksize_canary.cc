@@ -0,0 +1,457 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+unsigned int disksize_canary_interval = DISKSIZE_DEFAULT_CANARY_INTERVAL;
+
+/* Values of enum('WRITE_SYNC','READ') */
+#define DISKSIZE_CANARY_WRITE_SYNC 1ULL
+#define DISKSIZE_CANARY_READ 2ULL
+
+/*
+  DATA
+
+  The file and the block of a filesystem are used by its probe while one is
+  running, and freed by whoever drops the last reference: a probe stuck on
+  a hung mount keeps them alive without blocking the canary thread.
+*/
+
+struct Canary_filesystem {
+  std::string dir_name;
+  std::string file_name;
+  int fd{-1};
+  /* Aligned block written and read back */
+  void *block{nullptr};
+
+  /* Only used by the canary thread */
+  /* No O_DIRECT there (tmpfs), or the file could not be created */
+  bool skipped{false};
+  Disksize_timer_stats write_stats;
+  Disksize_timer_stats read_stats;
+  unsigned long long write_errors{0};
+  unsigned long long read_errors{0};
+  unsigned long long write_timeouts{0};
+  unsigned long long read_timeouts{0};
+
+  ~Canary_filesystem() {
+    if (fd != -1)
+      close(fd);
+    free(block);
+  }
+};
+
+/*
+  Open and preallocate the canary file, false on success. The file is
+  unlinked as soon as it is allocated: the block stays usable through the
+  descriptor and no file is ever left behind.
+*/
+static bool open_canary(Canary_filesystem *fs)
+{
+  char msgbuf[1024];
+
+  fs->fd = open(fs->file_name.c_str(),
+                O_RDWR | O_CREAT | O_DIRECT | O_CLOEXEC, 0600);
+  if (fs->fd == -1)
+  {
+    snprintf(msgbuf, sizeof(msgbuf),
+             "No latency probe for %s: could not open %s with O_DIRECT: %s",
+             fs->dir_name.c_str(), fs->file_name.c_str(), strerror(errno));
+    LogComponentErr(WARNING_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+    return true;
+  }
+
+  // The block is allocated now, so the probe still works on a full disk
+  int error = posix_fallocate(fs->fd, 0, DISKSIZE_CANARY_BLOCK_SIZE);
+  unlink(fs->file_name.c_str());
+  if (error != 0)
+  {
+    snprintf(msgbuf, sizeof(msgbuf),
+             "No latency probe for %s: could not preallocate %s: %s",
+             fs->dir_name.c_str(), fs->file_name.c_str(), strerror(error));
+    LogComponentErr(WARNING_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+    close(fs->fd);
+    fs->fd = -1;
+    return true;
+  }
+  return false;
+}
+
+/* One write, sync and read of a filesystem, run by the probe pool */
+class Canary_probe : public Disksize_probe {
+ public:
+  std::shared_ptr<Canary_filesystem> m_fs;
+  unsigned char m_pattern{0};
+  /* The operation running, the one a timeout is counted for */
+  std::atomic<unsigned long long> m_operation{DISKSIZE_CANARY_WRITE_SYNC};
+  bool m_skipped{false};
+  bool m_write_ok{false};
+  unsigned long long m_write_ns{0};
+  bool m_read_ok{false};
+  unsigned long long m_read_ns{0};
+
+  void run() override {
+    Canary_filesystem *fs = m_fs.get();
+    if (fs->fd == -1 && open_canary(fs))
+    {
+      m_skipped = true;
+      return;
+    }
+    memset(fs->block, m_pattern, DISKSIZE_CANARY_BLOCK_SIZE);
+
+    unsigned long long started_at = disksize_now_ns();
+    m_write_ok = pwrite(fs->fd, fs->block, DISKSIZE_CANARY_BLOCK_SIZE, 0) ==
+                     DISKSIZE_CANARY_BLOCK_SIZE &&
+                 fdatasync(fs->fd) == 0;
+    m_write_ns = disksize_now_ns() - started_at;
+
+    m_operation.store(DISKSIZE_CANARY_READ, std::memory_order_relaxed);
+    started_at = disksize_now_ns();
+    m_read_ok = pread(fs->fd, fs->block, DISKSIZE_CANARY_BLOCK_SIZE, 0) ==
+                DISKSIZE_CANARY_BLOCK_SIZE;
+    m_read_ns = disksize_now_ns() - started_at;
+  }
+};
+
+/* Only used by the canary thread */
+static std::map<unsigned long long, std::shared_ptr<Canary_filesystem>>
+    canary_filesystems;
+/* Probes which did not return in time, at most one per filesystem */
+static std::map<unsigned long long, std::shared_ptr<Canary_probe>>
+    stuck_canary_probes;
+static unsigned char canary_pattern = 0;
+
+static Disksize_publisher<Disksize_canary_snapshot> canary_publisher;
+
+static std::thread canary_thread;
+static std::mutex canary_mutex;
+static std::condition_variable canary_cond;
+static std::atomic<bool> canary_stop_requested{false};
+static bool canary_wakeup_requested = false;
+
+/* Account for a probe that returned, however late */
+static void record_canary_done(const Canary_probe &probe)
+{
+  Canary_filesystem *fs = probe.m_fs.get();
+  if (probe.m_skipped)
+  {
+    fs->skipped = true;
+    return;
+  }
+  if (probe.m_write_ok)
+    fs->write_stats.record(probe.m_write_ns);
+  else
+    fs->write_errors++;
+  if (probe.m_read_ok)
+    fs->read_stats.record(probe.m_read_ns);
+  else
+    fs->read_errors++;
+}
+
+static void add_canary_row(Disksize_canary_snapshot *snapshot,
+                           unsigned long long device_id,
+                           const Canary_filesystem &fs,
+                           unsigned long long operation,
+                           const Disksize_timer_stats &stats,
+                           unsigned long long errors,
+                           unsigned long long timeouts)
+{
+  Disksize_canary_record &row = snapshot->m_rows.emplace_back();
+  row.m_device_id = device_id;
+  row.m_dir_name = fs.dir_name;
+  row.m_operation = operation;
+  row.m_count = stats.m_count.load(std::memory_order_relaxed);
+  row.m_errors = errors;
+  row.m_timeouts = timeouts;
+  row.m_p50 = stats.percentile(0.50);
+  row.m_p99 = stats.percentile(0.99);
+  row.m_max = stats.m_max.load(std::memory_order_relaxed);
+  row.m_last = stats.m_last.load(std::memory_order_relaxed);
+}
+
+/*
+  One block written, synced and read on each filesystem, all of them in
+  parallel. The pass is published after DISKSIZE_CANARY_TIMEOUT ms at most,
+  whatever the state of the filesystems.
+*/
+static void run_canary_pass(const Disksize_snapshot *sizes)
+{
+  std::set<unsigned long long> devices;
+  canary_pattern++;
+
+  for (const Disksize_record &row : sizes->m_rows)
+  {
+    unsigned long long device_id = row.disksize_device_id.val;
+    if (row.disksize_is_stale || devices.count(device_id) != 0 ||
+        devices.size() == DISKSIZE_CANARY_MAX_FILESYSTEMS)
+      continue;
+    devices.insert(device_id);
+
+    if (canary_filesystems.count(device_id) == 0)
+    {
+      auto fs = std::make_shared<Canary_filesystem>();
+      fs->dir_name = row.disksize_dir_name.view();
+      fs->file_name = fs->dir_name + "/" + DISKSIZE_CANARY_FILE_NAME;
+      if (posix_memalign(&fs->block, DISKSIZE_CANARY_BLOCK_SIZE,
+                         DISKSIZE_CANARY_BLOCK_SIZE) != 0)
+      {
+        fs->block = nullptr;
+        fs->skipped = true;
+      }
+      canary_filesystems[device_id] = fs;
+    }
+  }
+
+  // Filesystems not monitored anymore, a stuck probe keeps its own alive
+  for (auto it = canary_filesystems.begin(); it != canary_filesystems.end();)
+  {
+    if (devices.count(it->first) == 0)
+    {
+      stuck_canary_probes.erase(it->first);
+      it = canary_filesystems.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  std::vector<std::shared_ptr<Disksize_probe>> probes;
+  std::map<unsigned long long, std::shared_ptr<Canary_probe>> by_device;
+  for (auto &entry : canary_filesystems)
+  {
+    auto stuck = stuck_canary_probes.find(entry.first);
+    if (stuck != stuck_canary_probes.end())
+    {
+      if (!stuck->second->is_done())
+        continue;
+      record_canary_done(*stuck->second);
+      stuck_canary_probes.erase(stuck);
+    }
+    if (entry.second->skipped)
+      continue;
+    auto probe = std::make_shared<Canary_probe>();
+    probe->m_fs = entry.second;
+    probe->m_pattern = canary_pattern;
+    by_device[entry.first] = probe;
+    probes.push_back(probe);
+  }
+  disksize_probe_run(probes, DISKSIZE_CANARY_TIMEOUT);
+
+  for (auto &device : by_device)
+  {
+    const auto &probe = device.second;
+    Canary_filesystem *fs = probe->m_fs.get();
+    if (probe->is_done())
+    {
+      record_canary_done(*probe);
+      continue;
+    }
+    // Not started: the pool was busy, it is simply tried again next time
+    if (!probe->is_started())
+      continue;
+    if (probe->m_operation.load(std::memory_order_relaxed) ==
+        DISKSIZE_CANARY_READ)
+      fs->read_timeouts++;
+    else
+      fs->write_timeouts++;
+    stuck_canary_probes[device.first] = probe;
+  }
+
+  Disksize_canary_snapshot *snapshot = new Disksize_canary_snapshot;
+  for (auto &entry : canary_filesystems)
+  {
+    const Canary_filesystem &fs = *entry.second;
+    if (fs.skipped)
+      continue;
+    add_canary_row(snapshot, entry.first, fs, DISKSIZE_CANARY_WRITE_SYNC,
+                   fs.write_stats, fs.write_errors, fs.write_timeouts);
+    add_canary_row(snapshot, entry.first, fs, DISKSIZE_CANARY_READ,
+                   fs.read_stats, fs.read_errors, fs.read_timeouts);
+  }
+  canary_publisher.publish(snapshot);
+}
+
+/*
+  CANARY thread
+*/
+
+static void canary_main()
+{
+  std::unique_lock<std::mutex> lock(canary_mutex);
+  while (!canary_stop_requested.load())
+  {
+    bool wait_for_snapshot = false;
+    if (disksize_canary_interval > 0)
+    {
+      lock.unlock();
+      Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+      wait_for_snapshot = (snapshot == nullptr);
+      if (!wait_for_snapshot)
+        run_canary_pass(snapshot);
+      disksize_snapshot_release(snapshot);
+      lock.lock();
+    }
+
+    canary_wakeup_requested = false;
+    auto predicate = [] {
+      return canary_stop_requested.load() || canary_wakeup_requested;
+    };
+    if (wait_for_snapshot)
+      canary_cond.wait_for(lock, std::chrono::seconds(1), predicate);
+    else if (disksize_canary_interval == 0)
+      canary_cond.wait(lock, predicate);
+    else
+      canary_cond.wait_for(
+          lock, std::chrono::seconds(disksize_canary_interval), predicate);
+  }
+}
+
+bool disksize_canary_start()
+{
+  canary_publisher.init(&LOCK_disksize_data);
+  canary_stop_requested.store(false);
+  canary_wakeup_requested = false;
+  try
+  {
+    canary_thread = std::thread(canary_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the latency probe thread");
+    return true;
+  }
+  return false;
+}
+
+/*
+  The thread never blocks in I/O, it is joined after its current pass. A
+  probe stuck on a hung mount is left to the probe pool, which frees its
+  file and block when it returns.
+*/
+void disksize_canary_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(canary_mutex);
+    canary_stop_requested.store(true);
+  }
+  canary_cond.notify_all();
+  if (canary_thread.joinable())
+    canary_thread.join();
+  stuck_canary_probes.clear();
+  canary_filesystems.clear();
+  canary_publisher.cleanup();
+}
+
+void disksize_canary_wakeup()
+{
+  {
+    std::lock_guard<std::mutex> lock(canary_mutex);
+    canary_wakeup_requested = true;
+  }
+  canary_cond.notify_all();
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_canary_st_share;
+
+typedef Disksize_snapshot_table<Disksize_canary_snapshot,
+                                Disksize_canary_record>
+    Disksize_canary_table;
+
+static void set_timer(PSI_field *field, const Disksize_canary_record &row,
+                      unsigned long long ns)
+{
+  pfs_bigint->set_unsigned(field, {ns * DISKSIZE_PICO_PER_NANO,
+                                   row.m_count == 0});
+}
+
+static void read_canary_column(const Disksize_canary_record &row,
+                               PSI_field *field, unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* DEVICE_ID */
+    pfs_bigint->set_unsigned(field, {row.m_device_id, false});
+    break;
+  case 1: /* DIR_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row.m_dir_name.data(),
+                                        (unsigned int)row.m_dir_name.length());
+    break;
+  case 2: /* OPERATION */
+    pfs_enum->set(field, {row.m_operation, false});
+    break;
+  case 3: /* COUNT_STAR */
+    pfs_bigint->set_unsigned(field, {row.m_count, false});
+    break;
+  case 4: /* COUNT_ERROR */
+    pfs_bigint->set_unsigned(field, {row.m_errors, false});
+    break;
+  case 5: /* COUNT_TIMEOUT */
+    pfs_bigint->set_unsigned(field, {row.m_timeouts, false});
+    break;
+  case 6: /* P50_TIMER_WAIT */
+    set_timer(field, row, row.m_p50);
+    break;
+  case 7: /* P99_TIMER_WAIT */
+    set_timer(field, row, row.m_p99);
+    break;
+  case 8: /* MAX_TIMER_WAIT */
+    set_timer(field, row, row.m_max);
+    break;
+  case 9: /* LAST_TIMER_WAIT */
+    set_timer(field, row, row.m_last);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_canary_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_latency";
+  share->m_table_name_length = 13;
+  share->m_table_definition =
+      "DEVICE_ID bigint unsigned not null, DIR_NAME varchar(255) not null, "
+      "OPERATION enum('WRITE_SYNC','READ') not null, "
+      "COUNT_STAR bigint unsigned not null, "
+      "COUNT_ERROR bigint unsigned not null, "
+      "COUNT_TIMEOUT bigint unsigned not null, "
+      "P50_TIMER_WAIT bigint unsigned, P99_TIMER_WAIT bigint unsigned, "
+      "MAX_TIMER_WAIT bigint unsigned, LAST_TIMER_WAIT bigint unsigned";
+  Disksize_canary_table::init_share<&canary_publisher,
+                                    read_canary_column>(share);
+}
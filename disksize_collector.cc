@@ -0,0 +1,819 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+unsigned int disksize_refresh_interval = DISKSIZE_DEFAULT_REFRESH_INTERVAL;
+unsigned int disksize_min_refresh_interval =
+    DISKSIZE_DEFAULT_MIN_REFRESH_INTERVAL;
+unsigned int disksize_forecast_half_life = DISKSIZE_DEFAULT_FORECAST_HALF_LIFE;
+
+/*
+  SNAPSHOT
+
+  Published lock-free (see Disksize_publisher), the publishers being
+  serialized by LOCK_disksize_data.
+*/
+
+static Disksize_publisher<Disksize_snapshot> snapshot_publisher;
+
+Disksize_snapshot *disksize_snapshot_acquire()
+{
+  return snapshot_publisher.acquire();
+}
+
+void disksize_snapshot_release(Disksize_snapshot *snapshot)
+{
+  snapshot_publisher.release(snapshot);
+}
+
+static void publish_disksize_snapshot(Disksize_snapshot *snapshot)
+{
+  snapshot_publisher.publish(snapshot);
+}
+
+void init_disksize_data()
+{
+  snapshot_publisher.init(&LOCK_disksize_data);
+}
+
+/* Called once the table is removed, nobody can hold a snapshot anymore */
+void cleanup_disksize_data()
+{
+  snapshot_publisher.cleanup();
+}
+
+/*
+  DATA collection
+*/
+
+/*
+  FILESYSTEM probes
+
+  Most of the monitored directories live on the same filesystem, so every
+  path is first resolved to its device with stat() and statvfs() is only
+  called once per device for each refresh.
+
+  The system calls run in the probe pool with a deadline: a hung NFS mount
+  or a dying disk only delays the rows of its own paths, which keep their
+  last known values flagged as stale.
+*/
+
+struct Disksize_filesystem {
+  dev_t device_id;
+  std::string mount_point;
+  std::string fs_type;
+  std::string mount_options;
+  long long unsigned int free;
+  long long unsigned int size;
+  unsigned long long sampled_at;
+  PSI_bigint fill_rate;
+  PSI_ubigint seconds_to_full;
+};
+
+/*
+  FORECAST
+
+  The fill rate of each filesystem is an exponentially weighted moving
+  average of the consumption between two samples, updated in O(1) for
+  every probe. The weight of a sample depends on the time elapsed since the
+  previous one, disksize.forecast_half_life seconds halving the weight of
+  the past, so irregular sampling intervals are handled correctly.
+*/
+
+struct Disksize_forecast_state {
+  unsigned long long last_sampled_at{0};
+  long long unsigned int last_free{0};
+  double rate{0};
+  bool has_rate{false};
+};
+
+/* Estimator of each device seen so far, only used by the collector */
+static std::map<dev_t, Disksize_forecast_state> forecast_states;
+
+static void update_forecast(Disksize_filesystem *fs,
+                            unsigned long long sampled_at)
+{
+  Disksize_forecast_state &state = forecast_states[fs->device_id];
+
+  if (state.last_sampled_at != 0 && sampled_at > state.last_sampled_at)
+  {
+    double elapsed = (sampled_at - state.last_sampled_at) / 1000000.0;
+    double rate = ((double)state.last_free - (double)fs->free) / elapsed;
+
+    if (!state.has_rate)
+      state.rate = rate;
+    else
+      state.rate += (1.0 - std::exp2(-elapsed / disksize_forecast_half_life)) *
+                    (rate - state.rate);
+    state.has_rate = true;
+  }
+  state.last_sampled_at = sampled_at;
+  state.last_free = fs->free;
+
+  fs->fill_rate = {(long long)std::llround(state.rate), !state.has_rate};
+  if (state.has_rate && state.rate > 0)
+    fs->seconds_to_full = {(long long unsigned int)(fs->free / state.rate),
+                           false};
+  else
+    fs->seconds_to_full = {0, true};
+}
+
+/*
+  SCHEDULER
+
+  Each filesystem has its own due time: disksize.refresh_interval while it
+  has headroom, less when it fills up or has little space left, down to
+  disksize.min_refresh_interval. The due times are kept in a min-heap, the
+  collector sleeps until the earliest one and only probes the filesystems
+  that are due. Rescheduling pushes a new entry, the outdated ones are
+  dropped when they reach the top.
+*/
+
+struct Disksize_due {
+  /* disksize_now_ns() time */
+  unsigned long long due_at;
+  dev_t device_id;
+};
+
+static std::vector<Disksize_due> due_heap;
+/* Current due time of each scheduled device */
+static std::map<dev_t, unsigned long long> device_due_at;
+
+static bool due_later(const Disksize_due &a, const Disksize_due &b)
+{
+  return a.due_at > b.due_at;
+}
+
+static void schedule_device(dev_t device_id, unsigned long long due_at)
+{
+  device_due_at[device_id] = due_at;
+  due_heap.push_back({due_at, device_id});
+  std::push_heap(due_heap.begin(), due_heap.end(), due_later);
+}
+
+static bool is_device_due(dev_t device_id, unsigned long long now)
+{
+  auto due = device_due_at.find(device_id);
+  return due == device_due_at.end() || due->second <= now;
+}
+
+/* Earliest due time, ULLONG_MAX when nothing is scheduled */
+static unsigned long long next_device_due()
+{
+  while (!due_heap.empty())
+  {
+    const Disksize_due &top = due_heap.front();
+    auto due = device_due_at.find(top.device_id);
+    if (due != device_due_at.end() && due->second == top.due_at)
+      return top.due_at;
+    std::pop_heap(due_heap.begin(), due_heap.end(), due_later);
+    due_heap.pop_back();
+  }
+  return ULLONG_MAX;
+}
+
+/* Devices that were due and not rescheduled are not monitored anymore */
+static void forget_unscheduled_devices(unsigned long long now)
+{
+  for (auto it = device_due_at.begin(); it != device_due_at.end();)
+  {
+    if (it->second <= now)
+      it = device_due_at.erase(it);
+    else
+      ++it;
+  }
+}
+
+/* Time until the next probe of a filesystem that was just sampled */
+static unsigned long long adaptive_interval_ns(const Disksize_filesystem &fs)
+{
+  double max_interval = disksize_refresh_interval;
+  double min_interval =
+      std::min(disksize_min_refresh_interval, disksize_refresh_interval);
+  double interval = max_interval;
+
+  // Enough samples before it is full to see it coming
+  if (!fs.seconds_to_full.is_null)
+    interval = std::min(interval, (double)fs.seconds_to_full.val /
+                                      DISKSIZE_SAMPLES_BEFORE_FULL);
+  // Little headroom: a burst would go unnoticed for too long
+  if (fs.size > 0)
+  {
+    double free_pct = 100.0 * fs.free / fs.size;
+    if (free_pct < DISKSIZE_LOW_HEADROOM_PCT)
+      interval =
+          std::min(interval, max_interval * free_pct / DISKSIZE_LOW_HEADROOM_PCT);
+  }
+
+  return (unsigned long long)(std::max(interval, min_interval) * 1e9);
+}
+
+/*
+  Absolute path without symbolic links of each device seen so far, the
+  path it was first probed through. Emptied when the mount table changes.
+  Only used by the collector.
+*/
+static std::map<dev_t, std::string> resolved_path_cache;
+
+/*
+  The mount is looked up in the mount table for every filesystem row, so a
+  filesystem mounted or unmounted over a path shows up on the next refresh.
+  The device decides, the resolved path only picks among its bind mounts.
+*/
+static const Disksize_mount *mount_of_device(dev_t device_id)
+{
+  auto resolved = resolved_path_cache.find(device_id);
+  return disksize_mount_of(device_id, resolved != resolved_path_cache.end()
+                                          ? resolved->second
+                                          : std::string_view());
+}
+
+/* stat() of a monitored path, to know its device */
+class Disksize_path_probe : public Disksize_probe {
+ public:
+  std::string m_path;
+  int m_errno{0};
+  dev_t m_device_id{0};
+
+  void run() override {
+    struct stat path_stat;
+    if (stat(m_path.c_str(), &path_stat) == -1)
+      m_errno = errno;
+    else
+      m_device_id = path_stat.st_dev;
+  }
+};
+
+/* statvfs() of a filesystem through one of its paths */
+class Disksize_filesystem_probe : public Disksize_probe {
+ public:
+  std::string m_path;
+  dev_t m_device_id{0};
+  bool m_want_resolved_path{false};
+  int m_errno{0};
+  long long unsigned int m_free{0};
+  long long unsigned int m_size{0};
+  std::string m_resolved_path;
+
+  void run() override {
+    struct statvfs buf;
+    if (statvfs(m_path.c_str(), &buf) == -1)
+    {
+      m_errno = errno;
+      return;
+    }
+    m_size = (long long unsigned int)buf.f_blocks * buf.f_bsize;
+    m_free = (long long unsigned int)buf.f_bavail * buf.f_bsize;
+    char resolved[PATH_MAX];
+    if (m_want_resolved_path)
+      m_resolved_path =
+          (realpath(m_path.c_str(), resolved) != nullptr) ? resolved : m_path;
+  }
+};
+
+/*
+  Probes still blocked since a previous refresh: neither they nor the other
+  paths of their device are queued again until they return, see
+  find_stuck_devices().
+*/
+static std::map<std::string, std::shared_ptr<Disksize_path_probe>>
+    stuck_path_probes;
+static std::map<dev_t, std::shared_ptr<Disksize_filesystem_probe>>
+    stuck_filesystem_probes;
+
+/* Last values read for each path, served as stale when its probe is late */
+static std::map<std::string, Disksize_filesystem> last_good_filesystems;
+
+enum Disksize_probe_status { PROBE_OK, PROBE_LATE, PROBE_FAILED };
+
+struct Disksize_path_state {
+  Disksize_probe_status status{PROBE_LATE};
+  dev_t device_id{0};
+  const Disksize_filesystem *fs{nullptr};
+};
+
+/*
+  Statistics of each probe, shown in disksize_collector_stats. A filesystem
+  is named after its mount point, or after the path it was first probed
+  through when that probe did not return in time.
+*/
+static Disksize_probe_stats *probe_stats_of(const Disksize_path_probe &probe)
+{
+  return disksize_path_stats(probe.m_path);
+}
+
+static Disksize_probe_stats *probe_stats_of(
+    const Disksize_filesystem_probe &probe)
+{
+  const Disksize_mount *mount = mount_of_device(probe.m_device_id);
+  return disksize_filesystem_stats(probe.m_device_id,
+                                   mount != nullptr ? mount->m_mount_point
+                                                    : probe.m_path);
+}
+
+/* Account for a probe that returned, however late */
+template <class T>
+static void record_probe_done(const T &probe)
+{
+  Disksize_probe_stats *stats = probe_stats_of(probe);
+  if (stats == nullptr)
+    return;
+  stats->m_latency.record(probe.m_latency);
+  if (probe.m_errno != 0)
+    stats->m_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class T>
+static void record_probe_timeout(const T &probe)
+{
+  Disksize_probe_stats *stats = probe_stats_of(probe);
+  if (stats != nullptr)
+    stats->m_timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class P>
+static bool is_stuck(P &stuck_probes, const typename P::key_type &key)
+{
+  auto found = stuck_probes.find(key);
+  if (found == stuck_probes.end())
+    return false;
+  if (!found->second->is_done())
+    return true;
+  record_probe_done(*found->second);
+  stuck_probes.erase(found);
+  return false;
+}
+
+static void log_probe_problem(const std::string &path, int error)
+{
+  char msgbuf[1024];
+  if (error != 0)
+    sprintf(msgbuf, "OS File access problem to %s", path.c_str());
+  else
+    sprintf(msgbuf,
+            "OS File access to %s did not answer within %u ms, "
+            "its last known values are reported as stale",
+            path.c_str(), disksize_probe_timeout);
+  LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+}
+
+/*
+  Device of each path from its last stat(), 0 when it failed. Only used by
+  the collector.
+*/
+static std::map<std::string, dev_t> path_devices;
+
+/*
+  Devices with a probe still blocked, by their last known device for the
+  paths. The other paths last seen on such a device are not probed until
+  it answers again, so a hung mount holds the workers already stuck on it
+  and no more. Probes which returned meanwhile are accounted for here.
+*/
+static std::set<dev_t> find_stuck_devices()
+{
+  std::set<dev_t> stuck_devices;
+  for (auto it = stuck_path_probes.begin(); it != stuck_path_probes.end();)
+  {
+    if (it->second->is_done())
+    {
+      record_probe_done(*it->second);
+      it = stuck_path_probes.erase(it);
+      continue;
+    }
+    auto device = path_devices.find(it->first);
+    if (device != path_devices.end() && device->second != 0)
+      stuck_devices.insert(device->second);
+    ++it;
+  }
+  for (auto it = stuck_filesystem_probes.begin();
+       it != stuck_filesystem_probes.end();)
+  {
+    if (it->second->is_done())
+    {
+      record_probe_done(*it->second);
+      it = stuck_filesystem_probes.erase(it);
+      continue;
+    }
+    stuck_devices.insert(it->first);
+    ++it;
+  }
+  return stuck_devices;
+}
+
+/*
+  Probe the paths in parallel: stat() every path when resolve_paths is set,
+  then statvfs() once per device that is due. Each step waits at most
+  disksize.probe_timeout ms, a path whose probe is late keeps PROBE_LATE.
+  The paths of a device that is not due are served its last values.
+*/
+static void probe_filesystems(
+    std::map<std::string, Disksize_path_state> *paths,
+    std::vector<Disksize_filesystem> *filesystems,
+    unsigned long long sampled_at, unsigned long long now, bool resolve_paths)
+{
+  std::vector<std::shared_ptr<Disksize_probe>> probes;
+  std::vector<std::shared_ptr<Disksize_path_probe>> path_probes;
+
+  if (resolve_paths)
+  {
+    std::set<dev_t> stuck_devices = find_stuck_devices();
+    for (auto &path : *paths)
+    {
+      auto device = path_devices.find(path.first);
+      if (stuck_path_probes.count(path.first) != 0 ||
+          (device != path_devices.end() &&
+           stuck_devices.count(device->second) != 0))
+        continue;
+      auto probe = std::make_shared<Disksize_path_probe>();
+      probe->m_path = path.first;
+      path_probes.push_back(probe);
+      probes.push_back(probe);
+    }
+    disksize_probe_run(probes, disksize_probe_timeout);
+  }
+  else
+  {
+    for (auto &path : *paths)
+    {
+      dev_t device_id = path_devices[path.first];
+      if (device_id == 0)
+        path.second.status = PROBE_FAILED;
+      else
+        path.second.device_id = device_id;
+    }
+  }
+
+  for (const auto &probe : path_probes)
+  {
+    Disksize_path_state &state = (*paths)[probe->m_path];
+    if (!probe->is_done())
+    {
+      record_probe_timeout(*probe);
+      if (probe->is_started())
+      {
+        stuck_path_probes[probe->m_path] = probe;
+        log_probe_problem(probe->m_path, 0);
+      }
+      continue;
+    }
+    record_probe_done(*probe);
+    if (probe->m_errno != 0)
+    {
+      state.status = PROBE_FAILED;
+      path_devices[probe->m_path] = 0;
+      log_probe_problem(probe->m_path, probe->m_errno);
+      continue;
+    }
+    state.device_id = probe->m_device_id;
+    path_devices[probe->m_path] = probe->m_device_id;
+  }
+
+  // A device is also due when one of its paths has never been served
+  std::set<dev_t> due_devices;
+  for (const auto &path : *paths)
+  {
+    const Disksize_path_state &state = path.second;
+    if (state.status == PROBE_FAILED || state.device_id == 0)
+      continue;
+    if (is_device_due(state.device_id, now) ||
+        last_good_filesystems.count(path.first) == 0)
+      due_devices.insert(state.device_id);
+  }
+
+  // One statvfs() per device, through the first path found on it
+  std::map<dev_t, std::shared_ptr<Disksize_filesystem_probe>> by_device;
+  probes.clear();
+  for (const auto &path : *paths)
+  {
+    dev_t device_id = path.second.device_id;
+    if (due_devices.count(device_id) == 0 || by_device.count(device_id) != 0 ||
+        is_stuck(stuck_filesystem_probes, device_id))
+      continue;
+    auto fs_probe = std::make_shared<Disksize_filesystem_probe>();
+    fs_probe->m_path = path.first;
+    fs_probe->m_device_id = device_id;
+    fs_probe->m_want_resolved_path =
+        (resolved_path_cache.count(device_id) == 0);
+    by_device[device_id] = fs_probe;
+    probes.push_back(fs_probe);
+  }
+  disksize_probe_run(probes, disksize_probe_timeout);
+
+  filesystems->reserve(by_device.size());
+  for (auto &device : by_device)
+  {
+    const auto &probe = device.second;
+    if (!probe->is_done())
+    {
+      record_probe_timeout(*probe);
+      if (probe->is_started())
+      {
+        stuck_filesystem_probes[device.first] = probe;
+        log_probe_problem(probe->m_path, 0);
+      }
+      continue;
+    }
+    if (probe->m_errno == 0 && probe->m_want_resolved_path)
+      resolved_path_cache[device.first] = probe->m_resolved_path;
+    record_probe_done(*probe);
+    if (probe->m_errno != 0)
+    {
+      log_probe_problem(probe->m_path, probe->m_errno);
+      continue;
+    }
+
+    Disksize_filesystem &fs = filesystems->emplace_back();
+    fs.device_id = device.first;
+    const Disksize_mount *mount = mount_of_device(device.first);
+    if (mount != nullptr)
+    {
+      fs.mount_point = mount->m_mount_point;
+      fs.fs_type = mount->m_fs_type;
+      fs.mount_options = mount->m_options;
+    }
+    else
+      fs.mount_point = resolved_path_cache[device.first];
+    fs.free = probe->m_free;
+    fs.size = probe->m_size;
+    fs.sampled_at = sampled_at;
+    update_forecast(&fs, sampled_at);
+  }
+
+  // Late or failed devices are tried again after the longest interval
+  for (dev_t device_id : due_devices)
+  {
+    unsigned long long interval = disksize_refresh_interval * 1000000000ULL;
+    for (const Disksize_filesystem &fs : *filesystems)
+      if (fs.device_id == device_id)
+        interval = adaptive_interval_ns(fs);
+    schedule_device(device_id, now + interval);
+  }
+
+  for (auto &path : *paths)
+  {
+    Disksize_path_state &state = path.second;
+    if (state.status == PROBE_FAILED)
+      continue;
+    for (const Disksize_filesystem &fs : *filesystems)
+    {
+      if (fs.device_id == state.device_id && state.device_id != 0)
+      {
+        state.status = PROBE_OK;
+        state.fs = &fs;
+        last_good_filesystems[path.first] = fs;
+      }
+    }
+    if (state.status == PROBE_OK)
+      continue;
+    // Not due, or late: serve the last known values, if any
+    auto last_good = last_good_filesystems.find(path.first);
+    if (last_good == last_good_filesystems.end())
+      continue;
+    state.fs = &last_good->second;
+    if (state.device_id != 0 && due_devices.count(state.device_id) == 0)
+      state.status = PROBE_OK;
+  }
+}
+
+/* Build the sorted row numbers used by the index scans of disks_size */
+static void index_disksize_snapshot(Disksize_snapshot *snapshot)
+{
+  const std::vector<Disksize_record> &rows = snapshot->m_rows;
+
+  snapshot->m_by_dir_name.resize(rows.size());
+  for (unsigned int i = 0; i < rows.size(); i++)
+    snapshot->m_by_dir_name[i] = i;
+  snapshot->m_by_related_variable = snapshot->m_by_dir_name;
+  snapshot->m_by_path = snapshot->m_by_dir_name;
+
+  std::sort(snapshot->m_by_dir_name.begin(), snapshot->m_by_dir_name.end(),
+            [&rows](unsigned int a, unsigned int b) {
+              int cmp = rows[a].disksize_dir_name.view().compare(
+                  rows[b].disksize_dir_name.view());
+              if (cmp != 0)
+                return cmp < 0;
+              return rows[a].disksize_related_variable.view() <
+                     rows[b].disksize_related_variable.view();
+            });
+  std::sort(snapshot->m_by_related_variable.begin(),
+            snapshot->m_by_related_variable.end(),
+            [&rows](unsigned int a, unsigned int b) {
+              return rows[a].disksize_related_variable.view() <
+                     rows[b].disksize_related_variable.view();
+            });
+  std::sort(snapshot->m_by_path.begin(), snapshot->m_by_path.end(),
+            [&rows](unsigned int a, unsigned int b) {
+              return disksize_path_key(rows[a].disksize_dir_name.view()) <
+                     disksize_path_key(rows[b].disksize_dir_name.view());
+            });
+}
+
+/* Time of the next stat() of all the paths, only used by the collector */
+static unsigned long long next_full_refresh_at = 0;
+
+/*
+  A full refresh reads the server variables and resolves every path to its
+  device again, every disksize.refresh_interval seconds. The refreshes in
+  between only probe the filesystems that are due.
+*/
+static void refresh_disksize_snapshot(bool force_full)
+{
+  unsigned long long now = disksize_now_ns();
+  bool full = force_full || now >= next_full_refresh_at;
+  std::vector<Disksize_filesystem> filesystems;
+  std::map<std::string, Disksize_path_state> paths;
+  size_t path_count = 0;
+  Disksize_snapshot *snapshot = new Disksize_snapshot;
+  std::vector<Disksize_record> &rows = snapshot->m_rows;
+
+  snapshot->m_sampled_at =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  // A mount or unmount may have changed what the paths resolve to
+  if (disksize_mounts_refresh())
+    resolved_path_cache.clear();
+  if (full)
+  {
+    disksize_refresh_parsed_variables();
+    next_full_refresh_at = now + disksize_refresh_interval * 1000000000ULL;
+  }
+  const std::vector<Disksize_parsed_variable> &parsed_variables =
+      disksize_parsed_variables();
+  for (const Disksize_parsed_variable &parsed : parsed_variables)
+    path_count += parsed.paths.size();
+  rows.reserve(std::min(path_count, (size_t)DISKSIZE_MAX_ROWS));
+
+  // Now let's get the info from disk, once per filesystem
+  for (const Disksize_parsed_variable &parsed : parsed_variables)
+    for (const auto &info_to_get : parsed.paths)
+    {
+      paths[info_to_get.second];
+      full = full || (path_devices.count(info_to_get.second) == 0);
+    }
+  probe_filesystems(&paths, &filesystems, snapshot->m_sampled_at, now, full);
+  forget_unscheduled_devices(now);
+
+  for (const Disksize_parsed_variable &parsed : parsed_variables)
+  {
+    for (const auto &info_to_get : parsed.paths)
+    {
+      if (rows.size() == DISKSIZE_MAX_ROWS)
+        break;
+
+      const Disksize_path_state &state = paths[info_to_get.second];
+      const Disksize_filesystem *fs = state.fs;
+      if (fs == nullptr)
+        continue;
+
+      // Rows are filled in place, in the storage reserved above
+      Disksize_record &record = rows.emplace_back();
+      record.disksize_dir_name.set(info_to_get.second);
+      record.disksize_related_variable.set(info_to_get.first);
+      record.disksize_dir_size_free = {fs->free, false};
+      record.disksize_dir_size_total = {fs->size, false};
+      record.disksize_device_id = {(long long unsigned int)fs->device_id,
+                                   false};
+      record.disksize_mount_point.set(fs->mount_point);
+      record.disksize_fs_type.set(fs->fs_type);
+      record.disksize_mount_options.set(fs->mount_options);
+      record.disksize_fill_rate = fs->fill_rate;
+      record.disksize_seconds_to_full = fs->seconds_to_full;
+      record.disksize_sampled_at = fs->sampled_at;
+      record.disksize_is_stale = (state.status != PROBE_OK);
+    }
+  }
+
+  index_disksize_snapshot(snapshot);
+  disksize_alerts_check(snapshot);
+  disksize_history_add(snapshot);
+  disksize_io_sample(snapshot);
+
+  // The log files are not tracked faster than the full refreshes
+  if (full)
+  {
+    Disksize_log_sources log_sources;
+    log_sources.m_binlog_basename =
+        disksize_parsed_raw_value("log_bin_basename");
+    log_sources.m_relay_log_basename =
+        disksize_parsed_raw_value("relay_log_basename");
+    log_sources.m_redo_home_dir =
+        disksize_parsed_raw_value("innodb_log_group_home_dir");
+    if (log_sources.m_redo_home_dir.empty())
+      log_sources.m_redo_home_dir = disksize_parsed_raw_value("datadir");
+    disksize_log_usage_refresh(log_sources);
+    disksize_thread_io_sample(snapshot->m_sampled_at);
+  }
+  disksize_temp_peaks_collect(snapshot);
+  disksize_shm_write(snapshot);
+
+  publish_disksize_snapshot(snapshot);
+}
+
+/*
+  COLLECTOR thread
+*/
+
+static std::thread collector_thread;
+static std::mutex collector_mutex;
+static std::condition_variable collector_cond;
+static bool collector_stop_requested = false;
+static bool collector_wakeup_requested = false;
+
+static void collector_main()
+{
+  std::unique_lock<std::mutex> lock(collector_mutex);
+  bool force_full = true;
+  while (!collector_stop_requested)
+  {
+    lock.unlock();
+    unsigned long long started_at = disksize_now_ns();
+    refresh_disksize_snapshot(force_full);
+    disksize_refresh_stats.record(disksize_now_ns() - started_at);
+    lock.lock();
+
+    // Sleep until the next full refresh or the first filesystem due
+    unsigned long long wake_at = std::min(next_full_refresh_at,
+                                          next_device_due());
+    unsigned long long now = disksize_now_ns();
+    collector_wakeup_requested = false;
+    collector_cond.wait_for(
+        lock, std::chrono::nanoseconds(wake_at > now ? wake_at - now : 0),
+        [] { return collector_stop_requested || collector_wakeup_requested; });
+    force_full = collector_wakeup_requested;
+  }
+}
+
+bool disksize_collector_start()
+{
+  due_heap.clear();
+  device_due_at.clear();
+  next_full_refresh_at = 0;
+  collector_stop_requested = false;
+  collector_wakeup_requested = false;
+  try
+  {
+    collector_thread = std::thread(collector_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the collector thread");
+    return true;
+  }
+  return false;
+}
+
+void disksize_collector_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(collector_mutex);
+    collector_stop_requested = true;
+  }
+  collector_cond.notify_all();
+  if (collector_thread.joinable())
+    collector_thread.join();
+  disksize_mounts_close();
+}
+
+/* Called when disksize.refresh_interval changes, so the new value is used
+   right away instead of after the current (possibly long) wait. */
+void disksize_collector_wakeup()
+{
+  {
+    std::lock_guard<std::mutex> lock(collector_mutex);
+    collector_wakeup_requested = true;
+  }
+  collector_cond.notify_all();
+}
@@ -0,0 +1,507 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+unsigned int disksize_dir_usage_interval = DISKSIZE_DEFAULT_DIR_USAGE_INTERVAL;
+unsigned int disksize_dir_usage_threads = DISKSIZE_DEFAULT_DIR_USAGE_THREADS;
+
+/*
+  DATA
+
+  What a pass learnt about a directory. It is reused as is by the next pass
+  when the mtime of the directory did not change, i.e. no entry was added,
+  removed or renamed. Files growing in place (.ibd, binlogs) do not change
+  the mtime of their directory, so every DISKSIZE_DIR_USAGE_FULL_SCAN_PASSES
+  passes all the directories are listed and their files stat'ed again.
+*/
+struct Dir_state {
+  struct timespec mtime;
+  unsigned long long file_count{0};
+  unsigned long long size{0};
+  unsigned long long allocated_size{0};
+  std::vector<std::string> subdirs;
+  unsigned int root{0};
+};
+
+typedef std::unordered_map<std::string, Dir_state> Dir_cache;
+
+/* Result of the last pass, only used by the walker thread */
+static Dir_cache dir_cache;
+static unsigned long long dir_usage_passes = 0;
+
+static Disksize_publisher<Disksize_dir_usage_snapshot> dir_usage_publisher;
+
+/*
+  WORK-STEALING walk
+
+  Each worker pushes the subdirectories it finds at the back of its own
+  queue and pops from there (depth first, good locality), an idle worker
+  steals from the front of the others (the largest subtrees).
+*/
+
+struct Walk_root {
+  std::string path;
+  std::string related_variable;
+  dev_t device_id;
+};
+
+struct Walk_task {
+  std::string path;
+  unsigned int root;
+};
+
+struct Walk_queue {
+  std::mutex mutex;
+  std::deque<Walk_task> tasks;
+};
+
+struct Walk {
+  const std::vector<Walk_root> *roots;
+  const Dir_cache *previous;
+  bool full_scan;
+  unsigned int worker_count;
+  std::unique_ptr<Walk_queue[]> queues;
+  /* Tasks queued or running, the pass is over when it drops to zero */
+  std::atomic<long> pending{0};
+  std::atomic<unsigned long long> dir_count{0};
+  std::vector<std::vector<std::pair<std::string, Dir_state>>> results;
+};
+
+static std::atomic<bool> dir_usage_stop_requested{false};
+
+static void push_task(Walk *walk, unsigned int worker, Walk_task &&task)
+{
+  walk->pending.fetch_add(1);
+  std::lock_guard<std::mutex> lock(walk->queues[worker].mutex);
+  walk->queues[worker].tasks.push_back(std::move(task));
+}
+
+static bool pop_task(Walk *walk, unsigned int worker, Walk_task *task)
+{
+  {
+    Walk_queue &own = walk->queues[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty())
+    {
+      *task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (unsigned int i = 1; i < walk->worker_count; i++)
+  {
+    Walk_queue &victim = walk->queues[(worker + i) % walk->worker_count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty())
+    {
+      *task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+static std::string child_path(const std::string &parent, const char *name)
+{
+  if (parent == "/")
+    return parent + name;
+  return parent + "/" + name;
+}
+
+static void walk_directory(Walk *walk, unsigned int worker,
+                           const Walk_task &task)
+{
+  const Walk_root &root = (*walk->roots)[task.root];
+  int fd = openat(AT_FDCWD, task.path.c_str(),
+                  O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1)
+    return;
+
+  struct stat dir_stat;
+  if (fstat(fd, &dir_stat) == -1)
+  {
+    close(fd);
+    return;
+  }
+
+  Dir_state state;
+  auto previous = walk->previous->find(task.path);
+  if (!walk->full_scan && previous != walk->previous->end() &&
+      previous->second.mtime.tv_sec == dir_stat.st_mtim.tv_sec &&
+      previous->second.mtime.tv_nsec == dir_stat.st_mtim.tv_nsec)
+  {
+    // Nothing was added or removed: no readdir, no fstatat
+    state = previous->second;
+    close(fd);
+  }
+  else
+  {
+    DIR *dir = fdopendir(fd);
+    if (dir == nullptr)
+    {
+      close(fd);
+      return;
+    }
+    state.mtime = dir_stat.st_mtim;
+    struct dirent *entry;
+    struct stat entry_stat;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        continue;
+      if (fstatat(dirfd(dir), entry->d_name, &entry_stat,
+                  AT_SYMLINK_NOFOLLOW) == -1)
+        continue;
+      if (S_ISREG(entry_stat.st_mode))
+      {
+        state.file_count++;
+        state.size += entry_stat.st_size;
+        state.allocated_size += (unsigned long long)entry_stat.st_blocks * 512;
+      }
+      else if (S_ISDIR(entry_stat.st_mode) &&
+               entry_stat.st_dev == root.device_id)
+        state.subdirs.push_back(entry->d_name);
+    }
+    closedir(dir);
+  }
+  state.root = task.root;
+
+  for (const std::string &subdir : state.subdirs)
+  {
+    if (walk->dir_count.fetch_add(1) >= DISKSIZE_DIR_USAGE_MAX_DIRS)
+      break;
+    push_task(walk, worker, {child_path(task.path, subdir.c_str()), task.root});
+  }
+
+  walk->results[worker].emplace_back(task.path, std::move(state));
+}
+
+static void walk_worker(Walk *walk, unsigned int worker)
+{
+  Walk_task task;
+  while (walk->pending.load() > 0 && !dir_usage_stop_requested.load())
+  {
+    if (!pop_task(walk, worker, &task))
+    {
+      // Nothing to steal right now, the other workers are listing big dirs
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+    walk_directory(walk, worker, task);
+    // Subdirectories were counted before this task is, pending never
+    // reaches zero while work is left
+    walk->pending.fetch_sub(1);
+  }
+}
+
+/* Distinct monitored directories, nested ones are walked with their parent */
+static void collect_walk_roots(std::vector<Walk_root> *roots)
+{
+  Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+  if (snapshot == nullptr)
+    return;
+
+  char resolved[PATH_MAX];
+  struct stat root_stat;
+  for (const Disksize_record &record : snapshot->m_rows)
+  {
+    std::string dir_name(record.disksize_dir_name.view());
+    if (realpath(dir_name.c_str(), resolved) == nullptr ||
+        stat(resolved, &root_stat) == -1)
+      continue;
+    roots->push_back({resolved,
+                      std::string(record.disksize_related_variable.view()),
+                      root_stat.st_dev});
+  }
+  disksize_snapshot_release(snapshot);
+
+  std::sort(roots->begin(), roots->end(),
+            [](const Walk_root &a, const Walk_root &b) {
+              return a.path < b.path;
+            });
+  std::vector<Walk_root> distinct;
+  for (Walk_root &root : *roots)
+  {
+    if (!distinct.empty())
+    {
+      const std::string &last = distinct.back().path;
+      if (root.path == last ||
+          (root.path.compare(0, last.length(), last) == 0 &&
+           (last == "/" || root.path[last.length()] == '/')))
+        continue;
+    }
+    distinct.push_back(std::move(root));
+  }
+  roots->swap(distinct);
+}
+
+static void run_dir_usage_pass()
+{
+  std::vector<Walk_root> roots;
+  collect_walk_roots(&roots);
+  if (roots.empty())
+    return;
+
+  Walk walk;
+  walk.roots = &roots;
+  walk.previous = &dir_cache;
+  walk.full_scan = (dir_usage_passes++ % DISKSIZE_DIR_USAGE_FULL_SCAN_PASSES) == 0;
+  walk.worker_count = std::max(1u, disksize_dir_usage_threads);
+  walk.queues.reset(new Walk_queue[walk.worker_count]);
+  walk.results.resize(walk.worker_count);
+
+  for (unsigned int i = 0; i < roots.size(); i++)
+    push_task(&walk, i % walk.worker_count, {roots[i].path, i});
+
+  std::vector<std::thread> workers;
+  try
+  {
+    for (unsigned int i = 1; i < walk.worker_count; i++)
+      workers.emplace_back(walk_worker, &walk, i);
+  }
+  catch (const std::system_error &)
+  {
+    // Fewer workers, the others steal their queues
+  }
+  walk_worker(&walk, 0);
+  for (std::thread &worker : workers)
+    worker.join();
+
+  if (dir_usage_stop_requested.load())
+    return;
+
+  Dir_cache cache;
+  for (auto &worker_results : walk.results)
+    for (auto &result : worker_results)
+      cache.emplace(std::move(result.first), std::move(result.second));
+
+  // Children sort after their parent: walk backwards to sum up the totals
+  Disksize_dir_usage_snapshot *snapshot = new Disksize_dir_usage_snapshot;
+  std::vector<const std::string *> paths;
+  paths.reserve(cache.size());
+  for (const auto &dir : cache)
+    paths.push_back(&dir.first);
+  std::sort(paths.begin(), paths.end(),
+            [](const std::string *a, const std::string *b) { return *a < *b; });
+
+  std::unordered_map<std::string, size_t> row_of;
+  snapshot->m_rows.resize(paths.size());
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    const Dir_state &state = cache[*paths[i]];
+    Disksize_dir_usage_record &row = snapshot->m_rows[i];
+    row.m_dir_name = *paths[i];
+    row.m_related_variable = roots[state.root].related_variable;
+    row.m_file_count = {state.file_count, false};
+    row.m_size = {state.size, false};
+    row.m_allocated_size = {state.allocated_size, false};
+    row.m_total_size = {state.size, false};
+    row_of.emplace(*paths[i], i);
+  }
+  for (size_t i = paths.size(); i-- > 0;)
+  {
+    const std::string &path = *paths[i];
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos || path == "/")
+      continue;
+    auto parent = row_of.find(slash == 0 ? std::string("/")
+                                         : path.substr(0, slash));
+    if (parent != row_of.end())
+      snapshot->m_rows[parent->second].m_total_size.val +=
+          snapshot->m_rows[i].m_total_size.val;
+  }
+
+  dir_cache.swap(cache);
+  dir_usage_publisher.publish(snapshot);
+}
+
+/*
+  WALKER thread
+*/
+
+static std::thread dir_usage_thread;
+static std::mutex dir_usage_mutex;
+static std::condition_variable dir_usage_cond;
+static bool dir_usage_wakeup_requested = false;
+
+static void dir_usage_main()
+{
+  std::unique_lock<std::mutex> lock(dir_usage_mutex);
+  while (!dir_usage_stop_requested.load())
+  {
+    bool wait_for_snapshot = false;
+    if (disksize_dir_usage_interval > 0)
+    {
+      lock.unlock();
+      Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+      wait_for_snapshot = (snapshot == nullptr);
+      disksize_snapshot_release(snapshot);
+      if (!wait_for_snapshot)
+        run_dir_usage_pass();
+      lock.lock();
+    }
+
+    dir_usage_wakeup_requested = false;
+    auto predicate = [] {
+      return dir_usage_stop_requested.load() || dir_usage_wakeup_requested;
+    };
+    if (wait_for_snapshot)
+      dir_usage_cond.wait_for(lock, std::chrono::seconds(1), predicate);
+    else if (disksize_dir_usage_interval == 0)
+      dir_usage_cond.wait(lock, predicate);
+    else
+      dir_usage_cond.wait_for(
+          lock, std::chrono::seconds(disksize_dir_usage_interval), predicate);
+  }
+}
+
+bool disksize_dir_usage_start()
+{
+  dir_usage_publisher.init(&LOCK_disksize_data);
+  dir_usage_stop_requested.store(false);
+  dir_usage_wakeup_requested = false;
+  dir_usage_passes = 0;
+  try
+  {
+    dir_usage_thread = std::thread(dir_usage_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the directory usage thread");
+    return true;
+  }
+  return false;
+}
+
+void disksize_dir_usage_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(dir_usage_mutex);
+    dir_usage_stop_requested.store(true);
+  }
+  dir_usage_cond.notify_all();
+  if (dir_usage_thread.joinable())
+    dir_usage_thread.join();
+  dir_cache.clear();
+  dir_usage_publisher.cleanup();
+}
+
+void disksize_dir_usage_wakeup()
+{
+  {
+    std::lock_guard<std::mutex> lock(dir_usage_mutex);
+    dir_usage_wakeup_requested = true;
+  }
+  dir_usage_cond.notify_all();
+}
+
+/*
+  Directories below the monitored ones as found by the last walk, or only
+  the monitored directories themselves when no walk has completed yet.
+*/
+void disksize_monitored_dirs(std::vector<Disksize_monitored_dir> *dirs)
+{
+  Disksize_dir_usage_snapshot *snapshot = dir_usage_publisher.acquire();
+  if (snapshot != nullptr)
+  {
+    dirs->reserve(snapshot->m_rows.size());
+    for (const Disksize_dir_usage_record &row : snapshot->m_rows)
+      dirs->push_back({row.m_dir_name, row.m_related_variable});
+    dir_usage_publisher.release(snapshot);
+    return;
+  }
+
+  std::vector<Walk_root> roots;
+  collect_walk_roots(&roots);
+  for (Walk_root &root : roots)
+    dirs->push_back({std::move(root.path), std::move(root.related_variable)});
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_dir_usage_st_share;
+
+typedef Disksize_snapshot_table<Disksize_dir_usage_snapshot,
+                                Disksize_dir_usage_record>
+    Disksize_dir_usage_table;
+
+static void read_dir_usage_column(const Disksize_dir_usage_record &row,
+                                  PSI_field *field, unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* DIR_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row.m_dir_name.data(),
+                                        (unsigned int)row.m_dir_name.length());
+    break;
+  case 1: /* RELATED_VARIABLE */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row.m_related_variable.data(),
+        (unsigned int)row.m_related_variable.length());
+    break;
+  case 2: /* FILE_COUNT */
+    pfs_bigint->set_unsigned(field, row.m_file_count);
+    break;
+  case 3: /* SIZE */
+    pfs_bigint->set_unsigned(field, row.m_size);
+    break;
+  case 4: /* ALLOCATED_SIZE */
+    pfs_bigint->set_unsigned(field, row.m_allocated_size);
+    break;
+  case 5: /* TOTAL_SIZE */
+    pfs_bigint->set_unsigned(field, row.m_total_size);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_dir_usage_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_usage_by_dir";
+  share->m_table_name_length = 18;
+  share->m_table_definition =
+      "DIR_NAME varchar(512) not null, RELATED_VARIABLE varchar(60) not null, "
+      "FILE_COUNT bigint unsigned, SIZE bigint unsigned, "
+      "ALLOCATED_SIZE bigint unsigned, TOTAL_SIZE bigint unsigned";
+  Disksize_dir_usage_table::init_share<&dir_usage_publisher,
+                                       read_dir_usage_column>(share);
+}
@@ -0,0 +1,370 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+unsigned int disksize_fragmentation_interval =
+    DISKSIZE_DEFAULT_FRAGMENTATION_INTERVAL;
+unsigned int disksize_fragmentation_scan_rate =
+    DISKSIZE_DEFAULT_FRAGMENTATION_SCAN_RATE;
+
+/*
+  DATA
+
+  What the previous pass learnt about each file, reused as long as its size
+  and mtime do not change.
+*/
+struct File_extents {
+  struct timespec mtime;
+  unsigned long long size;
+  unsigned long long allocated_size;
+  bool mapped;
+  unsigned long long extent_count;
+  unsigned long long extent_bytes;
+};
+
+typedef std::unordered_map<std::string, File_extents> File_extents_cache;
+
+/* Result of the last pass, only used by the fragmentation thread */
+static File_extents_cache extents_cache;
+
+static Disksize_publisher<Disksize_fragmentation_snapshot>
+    fragmentation_publisher;
+
+static std::thread fragmentation_thread;
+static std::mutex fragmentation_mutex;
+static std::condition_variable fragmentation_cond;
+static std::atomic<bool> fragmentation_stop_requested{false};
+static bool fragmentation_wakeup_requested = false;
+
+/*
+  Throttling: a pass makes at most disksize.fragmentation_scan_rate ioctls
+  per second, sleeping between them when it runs ahead.
+*/
+struct Fragmentation_pass {
+  std::chrono::steady_clock::time_point started_at;
+  unsigned long long calls{0};
+};
+
+/* False when the component is being stopped */
+static bool throttle(Fragmentation_pass *pass)
+{
+  pass->calls++;
+  auto due = pass->started_at +
+             std::chrono::microseconds((long long)(
+                 pass->calls * 1000000.0 / disksize_fragmentation_scan_rate));
+
+  std::unique_lock<std::mutex> lock(fragmentation_mutex);
+  fragmentation_cond.wait_until(
+      lock, due, [] { return fragmentation_stop_requested.load(); });
+  return !fragmentation_stop_requested.load();
+}
+
+/*
+  Count the extents of a file, physically contiguous extents being counted
+  as one: filesystems split long extents (128 MiB on ext4) and that is not
+  fragmentation. False when the filesystem does not support FIEMAP.
+
+  FIEMAP_FLAG_SYNC is not passed: it would write back the dirty pages of
+  the server's files from this thread, the I/O the pass must not add.
+  Data not written yet has no physical location (FIEMAP_EXTENT_UNKNOWN,
+  delayed allocation) and is left out of the extents instead.
+*/
+static bool map_extents(Fragmentation_pass *pass, int fd, File_extents *file)
+{
+  alignas(struct fiemap) char buffer[sizeof(struct fiemap) +
+                                     DISKSIZE_FIEMAP_BATCH *
+                                         sizeof(struct fiemap_extent)];
+  struct fiemap *map = (struct fiemap *)buffer;
+  unsigned long long start = 0;
+  unsigned long long next_physical = 0;
+  bool last = false;
+
+  file->extent_count = 0;
+  file->extent_bytes = 0;
+  while (!last)
+  {
+    memset(map, 0, sizeof(struct fiemap));
+    map->fm_start = start;
+    map->fm_length = FIEMAP_MAX_OFFSET - start;
+    map->fm_extent_count = DISKSIZE_FIEMAP_BATCH;
+    if (ioctl(fd, FS_IOC_FIEMAP, map) == -1 || !throttle(pass))
+      return false;
+    if (map->fm_mapped_extents == 0)
+      break;
+
+    for (unsigned int i = 0; i < map->fm_mapped_extents; i++)
+    {
+      const struct fiemap_extent &extent = map->fm_extents[i];
+      start = extent.fe_logical + extent.fe_length;
+      if (extent.fe_flags & FIEMAP_EXTENT_LAST)
+        last = true;
+      if (extent.fe_flags & FIEMAP_EXTENT_UNKNOWN)
+        continue;
+      if (file->extent_count == 0 || extent.fe_physical != next_physical)
+        file->extent_count++;
+      next_physical = extent.fe_physical + extent.fe_length;
+      file->extent_bytes += extent.fe_length;
+    }
+  }
+  return true;
+}
+
+static void fill_row(Disksize_fragmentation_record *row,
+                     const File_extents &file)
+{
+  row->m_extent_count = {file.extent_count, !file.mapped};
+  row->m_avg_extent_size = {
+      file.extent_count != 0 ? file.extent_bytes / file.extent_count : 0,
+      !file.mapped || file.extent_count == 0};
+  row->m_logical_size = {file.size, false};
+  row->m_allocated_size = {file.allocated_size, false};
+  row->m_sparse_size = {
+      file.size > file.allocated_size ? file.size - file.allocated_size : 0,
+      false};
+}
+
+static void run_fragmentation_pass()
+{
+  std::vector<Disksize_monitored_dir> dirs;
+  disksize_monitored_dirs(&dirs);
+  if (dirs.empty())
+    return;
+
+  File_extents_cache cache;
+  Disksize_fragmentation_snapshot *snapshot =
+      new Disksize_fragmentation_snapshot;
+  Fragmentation_pass pass;
+  pass.started_at = std::chrono::steady_clock::now();
+
+  for (const Disksize_monitored_dir &dir : dirs)
+  {
+    DIR *dirp = opendir(dir.m_dir_name.c_str());
+    if (dirp == nullptr)
+      continue;
+
+    struct dirent *entry;
+    struct stat file_stat;
+    while ((entry = readdir(dirp)) != nullptr &&
+           cache.size() < DISKSIZE_FRAGMENTATION_MAX_FILES)
+    {
+      if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+        continue;
+      if (fstatat(dirfd(dirp), entry->d_name, &file_stat,
+                  AT_SYMLINK_NOFOLLOW) == -1 ||
+          !S_ISREG(file_stat.st_mode))
+        continue;
+
+      std::string path = dir.m_dir_name;
+      if (path != "/")
+        path += '/';
+      path += entry->d_name;
+
+      File_extents file;
+      auto previous = extents_cache.find(path);
+      if (previous != extents_cache.end() &&
+          previous->second.size == (unsigned long long)file_stat.st_size &&
+          previous->second.mtime.tv_sec == file_stat.st_mtim.tv_sec &&
+          previous->second.mtime.tv_nsec == file_stat.st_mtim.tv_nsec)
+      {
+        // Unchanged since the previous pass: no open, no ioctl
+        file = previous->second;
+      }
+      else
+      {
+        file.mtime = file_stat.st_mtim;
+        file.size = file_stat.st_size;
+        file.allocated_size = (unsigned long long)file_stat.st_blocks * 512;
+        int fd = openat(dirfd(dirp), entry->d_name,
+                        O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1)
+          continue;
+        file.mapped = map_extents(&pass, fd, &file);
+        close(fd);
+      }
+
+      Disksize_fragmentation_record &row = snapshot->m_rows.emplace_back();
+      row.m_file_name = path;
+      row.m_related_variable = dir.m_related_variable;
+      fill_row(&row, file);
+      cache.emplace(std::move(path), file);
+
+      if (fragmentation_stop_requested.load())
+      {
+        closedir(dirp);
+        delete snapshot;
+        return;
+      }
+    }
+    closedir(dirp);
+  }
+
+  // Files gone since the previous pass are forgotten
+  extents_cache.swap(cache);
+  fragmentation_publisher.publish(snapshot);
+}
+
+/*
+  FRAGMENTATION thread
+*/
+
+static void fragmentation_main()
+{
+  std::unique_lock<std::mutex> lock(fragmentation_mutex);
+  while (!fragmentation_stop_requested.load())
+  {
+    bool wait_for_snapshot = false;
+    if (disksize_fragmentation_interval > 0)
+    {
+      lock.unlock();
+      Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+      wait_for_snapshot = (snapshot == nullptr);
+      disksize_snapshot_release(snapshot);
+      if (!wait_for_snapshot)
+        run_fragmentation_pass();
+      lock.lock();
+    }
+
+    fragmentation_wakeup_requested = false;
+    auto predicate = [] {
+      return fragmentation_stop_requested.load() ||
+             fragmentation_wakeup_requested;
+    };
+    if (wait_for_snapshot)
+      fragmentation_cond.wait_for(lock, std::chrono::seconds(1), predicate);
+    else if (disksize_fragmentation_interval == 0)
+      fragmentation_cond.wait(lock, predicate);
+    else
+      fragmentation_cond.wait_for(
+          lock, std::chrono::seconds(disksize_fragmentation_interval),
+          predicate);
+  }
+}
+
+bool disksize_fragmentation_start()
+{
+  fragmentation_publisher.init(&LOCK_disksize_data);
+  fragmentation_stop_requested.store(false);
+  fragmentation_wakeup_requested = false;
+  try
+  {
+    fragmentation_thread = std::thread(fragmentation_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the fragmentation thread");
+    return true;
+  }
+  return false;
+}
+
+void disksize_fragmentation_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(fragmentation_mutex);
+    fragmentation_stop_requested.store(true);
+  }
+  fragmentation_cond.notify_all();
+  if (fragmentation_thread.joinable())
+    fragmentation_thread.join();
+  extents_cache.clear();
+  fragmentation_publisher.cleanup();
+}
+
+void disksize_fragmentation_wakeup()
+{
+  {
+    std::lock_guard<std::mutex> lock(fragmentation_mutex);
+    fragmentation_wakeup_requested = true;
+  }
+  fragmentation_cond.notify_all();
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_fragmentation_st_share;
+
+typedef Disksize_snapshot_table<Disksize_fragmentation_snapshot,
+                                Disksize_fragmentation_record>
+    Disksize_fragmentation_table;
+
+static void read_fragmentation_column(const Disksize_fragmentation_record &row,
+                                      PSI_field *field, unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* FILE_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row.m_file_name.data(),
+                                        (unsigned int)row.m_file_name.length());
+    break;
+  case 1: /* RELATED_VARIABLE */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row.m_related_variable.data(),
+        (unsigned int)row.m_related_variable.length());
+    break;
+  case 2: /* EXTENT_COUNT */
+    pfs_bigint->set_unsigned(field, row.m_extent_count);
+    break;
+  case 3: /* AVG_EXTENT_SIZE */
+    pfs_bigint->set_unsigned(field, row.m_avg_extent_size);
+    break;
+  case 4: /* LOGICAL_SIZE */
+    pfs_bigint->set_unsigned(field, row.m_logical_size);
+    break;
+  case 5: /* ALLOCATED_SIZE */
+    pfs_bigint->set_unsigned(field, row.m_allocated_size);
+    break;
+  case 6: /* SPARSE_SIZE */
+    pfs_bigint->set_unsigned(field, row.m_sparse_size);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_fragmentation_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_fragmentation";
+  share->m_table_name_length = 19;
+  share->m_table_definition =
+      "FILE_NAME varchar(512) not null, RELATED_VARIABLE varchar(60) not null, "
+      "EXTENT_COUNT bigint unsigned, AVG_EXTENT_SIZE bigint unsigned, "
+      "LOGICAL_SIZE bigint unsigned, ALLOCATED_SIZE bigint unsigned, "
+      "SPARSE_SIZE bigint unsigned";
+  Disksize_fragmentation_table::init_share<&fragmentation_publisher,
+                                           read_fragmentation_column>(share);
+}
@@ -0,0 +1,330 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_timestamp_v2, pfs_timestamp);
+
+unsigned long disksize_history_size = DISKSIZE_DEFAULT_HISTORY_SIZE;
+unsigned long disksize_history_max_memory = DISKSIZE_DEFAULT_HISTORY_MAX_MEMORY;
+
+/*
+  DATA
+
+  One array per column: a scan of SAMPLED_AT or FREE_SIZE walks contiguous
+  memory, and an entry costs 26 bytes whatever the length of the paths.
+*/
+
+#define DISKSIZE_HISTORY_ENTRY_SIZE \
+  (3 * sizeof(unsigned long long) + sizeof(unsigned short))
+
+/* No name is stored for this entry: the name dictionary was full */
+#define DISKSIZE_HISTORY_NO_NAME 0xFFFF
+
+static size_t history_capacity = 0;
+static std::atomic<unsigned long long> *history_sampled_at = nullptr;
+static std::atomic<unsigned long long> *history_free = nullptr;
+static std::atomic<unsigned long long> *history_total = nullptr;
+static std::atomic<unsigned short> *history_name = nullptr;
+
+/* Number of entries written so far, and being written (writer side first) */
+static std::atomic<unsigned long long> history_head{0};
+static std::atomic<unsigned long long> history_reserved{0};
+
+/* Append only dictionary of the names referenced by the entries */
+static std::atomic<Disksize_history_name *> history_names[DISKSIZE_MAX_ROWS];
+static std::atomic<unsigned int> history_name_count{0};
+
+bool init_disksize_history()
+{
+  unsigned long long by_memory =
+      disksize_history_max_memory / DISKSIZE_HISTORY_ENTRY_SIZE;
+
+  history_capacity = disksize_history_size;
+  if (by_memory < history_capacity)
+    history_capacity = by_memory;
+
+  history_head.store(0);
+  history_reserved.store(0);
+  history_name_count.store(0);
+
+  if (history_capacity == 0)
+    return false;
+
+  try
+  {
+    history_sampled_at = new std::atomic<unsigned long long>[history_capacity];
+    history_free = new std::atomic<unsigned long long>[history_capacity];
+    history_total = new std::atomic<unsigned long long>[history_capacity];
+    history_name = new std::atomic<unsigned short>[history_capacity];
+  }
+  catch (const std::bad_alloc &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not allocate the history buffer");
+    cleanup_disksize_history();
+    return true;
+  }
+  return false;
+}
+
+/* Called once the collector is stopped and the table removed */
+void cleanup_disksize_history()
+{
+  delete[] history_sampled_at;
+  delete[] history_free;
+  delete[] history_total;
+  delete[] history_name;
+  history_sampled_at = nullptr;
+  history_free = nullptr;
+  history_total = nullptr;
+  history_name = nullptr;
+  history_capacity = 0;
+
+  unsigned int count = history_name_count.exchange(0);
+  for (unsigned int i = 0; i < count; i++)
+    delete history_names[i].exchange(nullptr);
+}
+
+/* Only called by the collector, the only writer of the dictionary */
+static unsigned short history_name_id(const Disksize_record &record)
+{
+  unsigned int count = history_name_count.load(std::memory_order_relaxed);
+
+  for (unsigned int i = 0; i < count; i++)
+  {
+    const Disksize_history_name *name =
+        history_names[i].load(std::memory_order_relaxed);
+    if (record.disksize_dir_name.view() == name->m_dir_name &&
+        record.disksize_related_variable.view() == name->m_related_variable)
+      return (unsigned short)i;
+  }
+
+  if (count == DISKSIZE_MAX_ROWS)
+    return DISKSIZE_HISTORY_NO_NAME;
+
+  Disksize_history_name *name = new Disksize_history_name;
+  name->m_dir_name = record.disksize_dir_name.view();
+  name->m_related_variable = record.disksize_related_variable.view();
+  history_names[count].store(name, std::memory_order_relaxed);
+  history_name_count.store(count + 1, std::memory_order_release);
+  return (unsigned short)count;
+}
+
+void disksize_history_add(const Disksize_snapshot *snapshot)
+{
+  if (history_capacity == 0)
+    return;
+
+  // Only what was measured now, the other rows are already in the history
+  for (const Disksize_record &record : snapshot->m_rows)
+  {
+    if (!snapshot->is_fresh(record))
+      continue;
+    unsigned short name_id = history_name_id(record);
+    if (name_id == DISKSIZE_HISTORY_NO_NAME)
+      continue;
+
+    unsigned long long seq = history_head.load(std::memory_order_relaxed);
+    size_t slot = seq % history_capacity;
+
+    // Announce the slot is being overwritten before touching it
+    history_reserved.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    history_sampled_at[slot].store(record.disksize_sampled_at,
+                                   std::memory_order_relaxed);
+    history_free[slot].store(record.disksize_dir_size_free.val,
+                             std::memory_order_relaxed);
+    history_total[slot].store(record.disksize_dir_size_total.val,
+                              std::memory_order_relaxed);
+    history_name[slot].store(name_id, std::memory_order_relaxed);
+
+    history_head.store(seq + 1, std::memory_order_release);
+  }
+}
+
+/* Read entry seq, false when it has been overwritten while reading it */
+static bool history_read(unsigned long long seq, Disksize_history_entry *entry)
+{
+  if (history_capacity == 0)
+    return false;
+
+  size_t slot = seq % history_capacity;
+  unsigned short name_id;
+
+  entry->m_sampled_at = history_sampled_at[slot].load(std::memory_order_relaxed);
+  entry->m_free = {history_free[slot].load(std::memory_order_relaxed), false};
+  entry->m_total = {history_total[slot].load(std::memory_order_relaxed), false};
+  name_id = history_name[slot].load(std::memory_order_relaxed);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (history_reserved.load(std::memory_order_relaxed) > seq + history_capacity)
+    return false;
+
+  if (name_id >= history_name_count.load(std::memory_order_acquire))
+    return false;
+  entry->m_name = history_names[name_id].load(std::memory_order_relaxed);
+  return true;
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_history_st_share;
+
+PSI_table_handle *disksize_history_open_table(PSI_pos **pos)
+{
+  MYSQL_THD thd;
+  Disksize_history_Table_Handle *temp = new Disksize_history_Table_Handle();
+
+  disksize_count_table_open();
+  mysql_service_mysql_current_thread_reader->get(&thd);
+  if (!have_required_privilege(thd))
+  {
+    mysql_error_service_printf(
+        ER_SPECIFIC_ACCESS_DENIED_ERROR, 0,
+        PRIVILEGE_NAME);
+  }
+  else
+  {
+    temp->m_end = history_head.load(std::memory_order_acquire);
+    temp->m_begin =
+        temp->m_end > history_capacity ? temp->m_end - history_capacity : 0;
+  }
+
+  temp->m_pos.set_at(temp->m_begin);
+  temp->m_next_pos.set_at(temp->m_begin);
+  *pos = (PSI_pos *)(&temp->m_pos);
+
+  return (PSI_table_handle *)temp;
+}
+
+void disksize_history_close_table(PSI_table_handle *handle)
+{
+  Disksize_history_Table_Handle *temp = (Disksize_history_Table_Handle *)handle;
+  disksize_count_rows_served(temp->m_rows_served);
+  delete temp;
+}
+
+int disksize_history_rnd_next(PSI_table_handle *handle)
+{
+  Disksize_history_Table_Handle *h = (Disksize_history_Table_Handle *)handle;
+
+  for (h->m_pos.set_at(&h->m_next_pos); h->m_pos.get_index() < h->m_end;
+       h->m_pos.set_at(h->m_pos.get_index() + 1))
+  {
+    // Entries overwritten since the table was opened are skipped
+    if (history_read(h->m_pos.get_index(), &h->current_row))
+    {
+      h->m_next_pos.set_after(&h->m_pos);
+      h->m_rows_served++;
+      return 0;
+    }
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int disksize_history_rnd_init(PSI_table_handle *, bool) { return 0; }
+
+int disksize_history_rnd_pos(PSI_table_handle *handle)
+{
+  Disksize_history_Table_Handle *h = (Disksize_history_Table_Handle *)handle;
+
+  if (!history_read(h->m_pos.get_index(), &h->current_row))
+    return PFS_HA_ERR_RECORD_DELETED;
+
+  return 0;
+}
+
+void disksize_history_reset_position(PSI_table_handle *handle)
+{
+  Disksize_history_Table_Handle *h = (Disksize_history_Table_Handle *)handle;
+  h->m_pos.set_at(h->m_begin);
+  h->m_next_pos.set_at(h->m_begin);
+  return;
+}
+
+int disksize_history_read_column_value(PSI_table_handle *handle,
+                                       PSI_field *field, unsigned int index)
+{
+  Disksize_history_Table_Handle *h = (Disksize_history_Table_Handle *)handle;
+  const Disksize_history_entry *row = &h->current_row;
+
+  switch (index)
+  {
+  case 0: /* SAMPLED_AT */
+    pfs_timestamp->set2(field, row->m_sampled_at);
+    break;
+  case 1: /* DIR_NAME */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row->m_name->m_dir_name.data(),
+        (unsigned int)row->m_name->m_dir_name.length());
+    break;
+  case 2: /* RELATED_VARIABLE */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row->m_name->m_related_variable.data(),
+        (unsigned int)row->m_name->m_related_variable.length());
+    break;
+  case 3: /* FREE_SIZE */
+    pfs_bigint->set_unsigned(field, row->m_free);
+    break;
+  case 4: /* TOTAL_SIZE */
+    pfs_bigint->set_unsigned(field, row->m_total);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+  return 0;
+}
+
+unsigned long long disksize_history_get_row_count(void)
+{
+  unsigned long long head = history_head.load(std::memory_order_relaxed);
+  return head < history_capacity ? head : history_capacity;
+}
+
+void init_disksize_history_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_size_history";
+  share->m_table_name_length = 18;
+  share->m_table_definition =
+      "SAMPLED_AT timestamp(6) not null, DIR_NAME varchar(255) not null, "
+      "RELATED_VARIABLE varchar(60) not null, FREE_SIZE bigint unsigned, "
+      "TOTAL_SIZE bigint unsigned";
+  share->m_ref_length = sizeof(Disksize_history_POS);
+  share->m_acl = READONLY;
+  share->get_row_count = disksize_history_get_row_count;
+  share->delete_all_rows = nullptr; /* READONLY TABLE */
+
+  share->m_proxy_engine_table = {
+      disksize_history_rnd_next, disksize_history_rnd_init,
+      disksize_history_rnd_pos,
+      nullptr, nullptr, nullptr,
+      disksize_history_read_column_value, disksize_history_reset_position,
+      /* READONLY TABLE */
+      nullptr, /* write_column_value */
+      nullptr, /* write_row_values */
+      nullptr, /* update_column_value */
+      nullptr, /* update_row_values */
+      nullptr, /* delete_row_values */
+      disksize_history_open_table, disksize_history_close_table};
+}
@@ -0,0 +1,294 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <charconv>
+#include <map>
+
+#include <fcntl.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+/* /proc/diskstats counts 512 bytes sectors, whatever the device */
+#define DISKSIZE_SECTOR_SIZE 512
+
+/*
+  DATA
+*/
+
+static Disksize_publisher<Disksize_io_snapshot> io_publisher;
+
+void init_disksize_io()
+{
+  io_publisher.init(&LOCK_disksize_data);
+}
+
+/* Called once the collector is stopped and the table removed */
+void cleanup_disksize_io()
+{
+  io_publisher.cleanup();
+}
+
+/* The fields of a /proc/diskstats line used here */
+struct Disksize_io_counters {
+  unsigned long long reads;
+  unsigned long long sectors_read;
+  unsigned long long ms_reading;
+  unsigned long long writes;
+  unsigned long long sectors_written;
+  unsigned long long ms_writing;
+  unsigned long long in_flight;
+  unsigned long long io_ticks;
+};
+
+/* Previous sample of each device, only used by the collector */
+struct Disksize_io_device {
+  Disksize_io_counters counters;
+  unsigned long long read_at;
+};
+static std::map<unsigned long long, Disksize_io_device> io_devices;
+
+/* Content of /proc/diskstats, the allocation is reused between samples */
+static std::string diskstats;
+
+static bool read_diskstats()
+{
+  int fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  diskstats.clear();
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    diskstats.append(buffer, n);
+  close(fd);
+  return n == 0;
+}
+
+/* Next blank separated token of line, empty at the end */
+static std::string_view next_token(std::string_view *line)
+{
+  size_t start = line->find_first_not_of(' ');
+  if (start == std::string_view::npos)
+  {
+    *line = std::string_view();
+    return *line;
+  }
+  size_t end = line->find(' ', start);
+  if (end == std::string_view::npos)
+    end = line->size();
+  std::string_view token = line->substr(start, end - start);
+  line->remove_prefix(end);
+  return token;
+}
+
+static unsigned long long next_number(std::string_view *line)
+{
+  std::string_view token = next_token(line);
+  unsigned long long value = 0;
+  std::from_chars(token.data(), token.data() + token.size(), value);
+  return value;
+}
+
+static double per_second(unsigned long long delta, double elapsed)
+{
+  return delta / elapsed;
+}
+
+static void fill_rates(Disksize_io_record *record,
+                       const Disksize_io_counters &previous,
+                       const Disksize_io_counters &current, double elapsed)
+{
+  // A counter going backwards is a wrap or a device replaced: no rate
+  if (current.reads < previous.reads ||
+      current.sectors_read < previous.sectors_read ||
+      current.ms_reading < previous.ms_reading ||
+      current.writes < previous.writes ||
+      current.sectors_written < previous.sectors_written ||
+      current.ms_writing < previous.ms_writing ||
+      current.io_ticks < previous.io_ticks || elapsed <= 0)
+    return;
+
+  unsigned long long ios =
+      (current.reads - previous.reads) + (current.writes - previous.writes);
+  unsigned long long busy_ms = (current.ms_reading - previous.ms_reading) +
+                               (current.ms_writing - previous.ms_writing);
+  double utilization =
+      (current.io_ticks - previous.io_ticks) / (elapsed * 1000.0) * 100.0;
+
+  record->m_read_iops = {per_second(current.reads - previous.reads, elapsed),
+                         false};
+  record->m_write_iops = {
+      per_second(current.writes - previous.writes, elapsed), false};
+  record->m_read_bytes_per_sec = {
+      per_second((current.sectors_read - previous.sectors_read) *
+                     DISKSIZE_SECTOR_SIZE,
+                 elapsed),
+      false};
+  record->m_write_bytes_per_sec = {
+      per_second((current.sectors_written - previous.sectors_written) *
+                     DISKSIZE_SECTOR_SIZE,
+                 elapsed),
+      false};
+  record->m_avg_service_time = {ios != 0 ? (double)busy_ms / ios : 0,
+                                ios == 0};
+  record->m_utilization = {std::min(utilization, 100.0), false};
+}
+
+/*
+  Paths are mapped to their block device by st_dev, which is the
+  major:minor of the partition or device-mapper volume they live on.
+  Filesystems without a block device (tmpfs, NFS, overlay) have no row.
+*/
+void disksize_io_sample(const Disksize_snapshot *snapshot)
+{
+  std::vector<unsigned long long> wanted;
+  for (const Disksize_record &record : snapshot->m_rows)
+    wanted.push_back(record.disksize_device_id.val);
+  std::sort(wanted.begin(), wanted.end());
+  wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+  if (!read_diskstats())
+  {
+    io_devices.clear();
+    io_publisher.publish(new Disksize_io_snapshot);
+    return;
+  }
+
+  unsigned long long read_at = disksize_now_ns();
+  std::map<unsigned long long, Disksize_io_device> devices;
+  Disksize_io_snapshot *io_snapshot = new Disksize_io_snapshot;
+  std::string_view remaining(diskstats);
+
+  while (!remaining.empty())
+  {
+    size_t eol = remaining.find('\n');
+    std::string_view line = remaining.substr(0, eol);
+    remaining.remove_prefix(eol == std::string_view::npos ? remaining.size()
+                                                          : eol + 1);
+
+    unsigned int major = (unsigned int)next_number(&line);
+    unsigned int minor = (unsigned int)next_number(&line);
+    unsigned long long device_id = makedev(major, minor);
+    if (!std::binary_search(wanted.begin(), wanted.end(), device_id))
+      continue;
+
+    std::string_view name = next_token(&line);
+    Disksize_io_counters counters;
+    counters.reads = next_number(&line);
+    next_number(&line); /* reads merged */
+    counters.sectors_read = next_number(&line);
+    counters.ms_reading = next_number(&line);
+    counters.writes = next_number(&line);
+    next_number(&line); /* writes merged */
+    counters.sectors_written = next_number(&line);
+    counters.ms_writing = next_number(&line);
+    counters.in_flight = next_number(&line);
+    counters.io_ticks = next_number(&line);
+
+    Disksize_io_record &record = io_snapshot->m_rows.emplace_back();
+    record.m_device_name.set(name);
+    record.m_device_id = {device_id, false};
+    record.m_read_iops = {0, true};
+    record.m_write_iops = {0, true};
+    record.m_read_bytes_per_sec = {0, true};
+    record.m_write_bytes_per_sec = {0, true};
+    record.m_avg_service_time = {0, true};
+    record.m_utilization = {0, true};
+    record.m_in_flight = {counters.in_flight, false};
+    record.m_sampled_at = snapshot->m_sampled_at;
+
+    auto previous = io_devices.find(device_id);
+    if (previous != io_devices.end())
+      fill_rates(&record, previous->second.counters, counters,
+                 (read_at - previous->second.read_at) / 1000000000.0);
+    devices[device_id] = {counters, read_at};
+  }
+
+  // Devices not monitored anymore are forgotten
+  io_devices.swap(devices);
+  io_publisher.publish(io_snapshot);
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_io_st_share;
+
+typedef Disksize_snapshot_table<Disksize_io_snapshot, Disksize_io_record>
+    Disksize_io_table;
+
+static void read_io_column(const Disksize_io_record &row, PSI_field *field,
+                           unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* DEVICE_NAME */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row.m_device_name.view().data(),
+        (unsigned int)row.m_device_name.view().length());
+    break;
+  case 1: /* DEVICE_ID */
+    pfs_bigint->set_unsigned(field, row.m_device_id);
+    break;
+  case 2: /* READ_IOPS */
+    pfs_double->set(field, row.m_read_iops);
+    break;
+  case 3: /* WRITE_IOPS */
+    pfs_double->set(field, row.m_write_iops);
+    break;
+  case 4: /* READ_BYTES_PER_SEC */
+    pfs_double->set(field, row.m_read_bytes_per_sec);
+    break;
+  case 5: /* WRITE_BYTES_PER_SEC */
+    pfs_double->set(field, row.m_write_bytes_per_sec);
+    break;
+  case 6: /* AVG_SERVICE_TIME */
+    pfs_double->set(field, row.m_avg_service_time);
+    break;
+  case 7: /* UTILIZATION */
+    pfs_double->set(field, row.m_utilization);
+    break;
+  case 8: /* IN_FLIGHT */
+    pfs_bigint->set_unsigned(field, row.m_in_flight);
+    break;
+  case 9: /* SAMPLED_AT */
+    pfs_timestamp->set2(field, row.m_sampled_at);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_io_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_io";
+  share->m_table_name_length = 8;
+  share->m_table_definition =
+      "DEVICE_NAME varchar(32) not null, DEVICE_ID bigint unsigned not null, "
+      "READ_IOPS double, WRITE_IOPS double, READ_BYTES_PER_SEC double, "
+      "WRITE_BYTES_PER_SEC double, AVG_SERVICE_TIME double, "
+      "UTILIZATION double, IN_FLIGHT bigint unsigned, "
+      "SAMPLED_AT timestamp(6) not null";
+  Disksize_io_table::init_share<&io_publisher, read_io_column>(share);
+}
@@ -0,0 +1,554 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Values of enum('BINARY','RELAY','REDO') */
+#define DISKSIZE_LOG_BINARY 1ULL
+#define DISKSIZE_LOG_RELAY 2ULL
+#define DISKSIZE_LOG_REDO 3ULL
+
+/*
+  DATA
+
+  Files of one log ordered by sequence number. Only the collector thread
+  uses them.
+*/
+struct Log_file {
+  unsigned long long sequence;
+  std::string name;
+  unsigned long long size;
+};
+
+struct Log_index {
+  unsigned long long type;
+  std::string dir;
+  /* File names are prefix followed by the sequence number */
+  std::string prefix;
+  std::vector<Log_file> files;
+  bool listed{false};
+  /* Digits of the newest sequence number, to build the next name */
+  unsigned int digits{1};
+
+  /* Bytes appended since the log is tracked, for GROWTH_RATE */
+  unsigned long long written{0};
+  unsigned long long rate_written{0};
+  unsigned long long rate_at{0};
+  PSI_double rate{0, true};
+};
+
+static Log_index log_indexes[3] = {{DISKSIZE_LOG_BINARY, {}, {}, {}},
+                                   {DISKSIZE_LOG_RELAY, {}, {}, {}},
+                                   {DISKSIZE_LOG_REDO, {}, {}, {}}};
+static unsigned long long log_usage_passes = 0;
+
+/* Probes still blocked since a previous refresh, one per index at most */
+class Log_index_probe;
+static std::shared_ptr<Log_index_probe> stuck_log_probes[3];
+
+static Disksize_publisher<Disksize_log_usage_snapshot> log_usage_publisher;
+
+void init_disksize_log_usage()
+{
+  log_usage_publisher.init(&LOCK_disksize_data);
+  log_usage_passes = 0;
+}
+
+/* Called once the collector is stopped and the table removed */
+void cleanup_disksize_log_usage()
+{
+  log_usage_publisher.cleanup();
+  for (std::shared_ptr<Log_index_probe> &probe : stuck_log_probes)
+    probe.reset();
+  for (Log_index &index : log_indexes)
+  {
+    index.dir.clear();
+    index.prefix.clear();
+    index.files = std::vector<Log_file>();
+    index.listed = false;
+  }
+}
+
+/* The sequence number of name, false when it is not a file of the log */
+static bool log_sequence(const Log_index &index, std::string_view name,
+                         unsigned long long *sequence, unsigned int *digits)
+{
+  if (name.size() <= index.prefix.size() ||
+      name.compare(0, index.prefix.size(), index.prefix) != 0)
+    return false;
+
+  std::string_view number = name.substr(index.prefix.size());
+  *sequence = 0;
+  for (char c : number)
+  {
+    if (c < '0' || c > '9')
+      return false;
+    *sequence = *sequence * 10 + (c - '0');
+  }
+  *digits = (unsigned int)number.size();
+  return true;
+}
+
+static std::string log_path(const Log_index &index, const std::string &name)
+{
+  return index.dir + "/" + name;
+}
+
+/* Size of a file of the log, false when it does not exist anymore */
+static bool log_file_size(const Log_index &index, const std::string &name,
+                          unsigned long long *size)
+{
+  struct stat file_stat;
+  if (stat(log_path(index, name).c_str(), &file_stat) == -1)
+    return false;
+  *size = file_stat.st_size;
+  return true;
+}
+
+static void account_growth(Log_index *index, unsigned long long before,
+                           unsigned long long after)
+{
+  if (after > before)
+    index->written += after - before;
+}
+
+/* Read the whole directory again */
+static void list_log_index(Log_index *index)
+{
+  std::vector<Log_file> files;
+  unsigned int digits = 1;
+
+  DIR *dirp = opendir(index->dir.c_str());
+  if (dirp != nullptr)
+  {
+    struct dirent *entry;
+    struct stat file_stat;
+    unsigned long long sequence;
+    unsigned int entry_digits;
+    while ((entry = readdir(dirp)) != nullptr &&
+           files.size() < DISKSIZE_LOG_USAGE_MAX_FILES)
+    {
+      if (!log_sequence(*index, entry->d_name, &sequence, &entry_digits) ||
+          fstatat(dirfd(dirp), entry->d_name, &file_stat, 0) == -1 ||
+          !S_ISREG(file_stat.st_mode))
+        continue;
+      files.push_back(
+          {sequence, entry->d_name, (unsigned long long)file_stat.st_size});
+    }
+    closedir(dirp);
+  }
+  std::sort(files.begin(), files.end(),
+            [](const Log_file &a, const Log_file &b) {
+              return a.sequence < b.sequence;
+            });
+  if (!files.empty())
+  {
+    unsigned long long sequence;
+    log_sequence(*index, files.back().name, &sequence, &digits);
+  }
+
+  // Growth since the previous listing, new files count as a whole
+  if (index->listed)
+  {
+    for (const Log_file &file : files)
+    {
+      auto previous = std::lower_bound(
+          index->files.begin(), index->files.end(), file.sequence,
+          [](const Log_file &f, unsigned long long s) {
+            return f.sequence < s;
+          });
+      if (previous != index->files.end() &&
+          previous->sequence == file.sequence)
+        account_growth(index, previous->size, file.size);
+      else if (index->files.empty() ||
+               file.sequence > index->files.back().sequence)
+        account_growth(index, 0, file.size);
+    }
+  }
+
+  index->files.swap(files);
+  index->digits = digits;
+  index->listed = true;
+}
+
+/* stat() the oldest, the newest and the next files only */
+static void update_log_index(Log_index *index)
+{
+  unsigned long long size;
+
+  // Purged files
+  size_t purged = 0;
+  while (purged < index->files.size() &&
+         !log_file_size(*index, index->files[purged].name, &size))
+    purged++;
+  index->files.erase(index->files.begin(), index->files.begin() + purged);
+
+  if (index->files.empty())
+  {
+    list_log_index(index);
+    return;
+  }
+
+  // The newest file is the only one still growing
+  Log_file &newest = index->files.back();
+  if (!log_file_size(*index, newest.name, &size))
+  {
+    list_log_index(index);
+    return;
+  }
+  account_growth(index, newest.size, size);
+  newest.size = size;
+
+  // New files
+  char name[DISKSIZE_LOG_FILE_NAME_LENGTH];
+  unsigned long long sequence = newest.sequence + 1;
+  while (index->files.size() < DISKSIZE_LOG_USAGE_MAX_FILES)
+  {
+    snprintf(name, sizeof(name), "%s%0*llu", index->prefix.c_str(),
+             (int)index->digits, sequence);
+    if (!log_file_size(*index, name, &size))
+      break;
+    index->files.push_back({sequence, name, size});
+    account_growth(index, 0, size);
+    sequence++;
+  }
+}
+
+/* Track dir/prefix, starting over when the server settings changed */
+static void configure_log_index(Log_index *index, std::string dir,
+                                std::string prefix)
+{
+  if (dir == index->dir && prefix == index->prefix)
+    return;
+  index->dir = std::move(dir);
+  index->prefix = std::move(prefix);
+  index->files.clear();
+  index->listed = false;
+  index->written = 0;
+  index->rate_written = 0;
+  index->rate_at = 0;
+  index->rate = {0, true};
+}
+
+/* "/var/lib/mysql/binlog" is read as "/var/lib/mysql" and "binlog." */
+static void configure_from_basename(Log_index *index,
+                                    const std::string &basename)
+{
+  if (basename.empty())
+  {
+    configure_log_index(index, "", "");
+    return;
+  }
+  size_t slash = basename.rfind('/');
+  if (slash == std::string::npos)
+    configure_log_index(index, ".", basename + ".");
+  else
+    configure_log_index(index, slash == 0 ? "/" : basename.substr(0, slash),
+                        basename.substr(slash + 1) + ".");
+}
+
+/* #innodb_redo/#ib_redoN since 8.0.30, ib_logfileN before */
+static void configure_redo(Log_index *index, const std::string &home_dir)
+{
+  std::string home = home_dir.empty() ? "." : home_dir;
+  while (home.size() > 1 && home.back() == '/')
+    home.pop_back();
+
+  std::string redo_dir = home + "/#innodb_redo";
+  struct stat dir_stat;
+  if (stat(redo_dir.c_str(), &dir_stat) == 0 && S_ISDIR(dir_stat.st_mode))
+    configure_log_index(index, redo_dir, "#ib_redo");
+  else
+    configure_log_index(index, home, "ib_logfile");
+}
+
+/*
+  Configures and refreshes one index on a probe thread. The index is only
+  touched by its probe, and a probe is not queued again while the previous
+  one of the same index has not returned.
+*/
+class Log_index_probe : public Disksize_probe {
+ public:
+  Log_index *m_index{nullptr};
+  /* Basename of the binary or relay log, home directory of the redo log */
+  std::string m_source;
+  bool m_full_scan{false};
+
+  void run() override {
+    if (m_index->type == DISKSIZE_LOG_REDO)
+      configure_redo(m_index, m_source);
+    else
+      configure_from_basename(m_index, m_source);
+    if (m_index->dir.empty())
+      return;
+    if (m_full_scan || !m_index->listed)
+      list_log_index(m_index);
+    else
+      update_log_index(m_index);
+  }
+};
+
+void disksize_log_usage_refresh(const Disksize_log_sources &sources)
+{
+  bool full_scan =
+      (log_usage_passes++ % DISKSIZE_LOG_USAGE_FULL_SCAN_PASSES) == 0;
+  const std::string *log_sources[3] = {&sources.m_binlog_basename,
+                                       &sources.m_relay_log_basename,
+                                       &sources.m_redo_home_dir};
+
+  std::shared_ptr<Log_index_probe> index_probes[3];
+  std::vector<std::shared_ptr<Disksize_probe>> probes;
+  for (int i = 0; i < 3; i++)
+  {
+    if (stuck_log_probes[i] != nullptr)
+    {
+      if (!stuck_log_probes[i]->is_done())
+        continue;
+      stuck_log_probes[i].reset();
+    }
+    index_probes[i] = std::make_shared<Log_index_probe>();
+    index_probes[i]->m_index = &log_indexes[i];
+    index_probes[i]->m_source = *log_sources[i];
+    index_probes[i]->m_full_scan = full_scan;
+    probes.push_back(index_probes[i]);
+  }
+  disksize_probe_run(probes, disksize_probe_timeout);
+
+  Disksize_log_usage_snapshot *previous = log_usage_publisher.acquire();
+  Disksize_log_usage_snapshot *snapshot = new Disksize_log_usage_snapshot;
+  unsigned long long now = disksize_now_ns();
+
+  for (int i = 0; i < 3; i++)
+  {
+    Log_index &index = log_indexes[i];
+    if (index_probes[i] == nullptr || !index_probes[i]->is_done())
+    {
+      if (index_probes[i] != nullptr && index_probes[i]->is_started())
+        stuck_log_probes[i] = index_probes[i];
+      // The index may be in use by the probe, the last rows are kept
+      if (previous != nullptr)
+        for (const Disksize_log_usage_record &row : previous->m_rows)
+          if (row.m_type == index.type)
+          {
+            snapshot->m_rows.push_back(row);
+            snapshot->m_rows.back().m_is_stale = true;
+          }
+      continue;
+    }
+    if (index.dir.empty())
+      continue;
+
+    if (index.rate_at != 0 && now > index.rate_at)
+      index.rate = {(index.written - index.rate_written) /
+                        ((now - index.rate_at) / 1000000000.0),
+                    false};
+    index.rate_written = index.written;
+    index.rate_at = now;
+
+    // Running total: the bytes a purge up to each file frees
+    unsigned long long bytes_before = 0;
+    for (const Log_file &file : index.files)
+    {
+      Disksize_log_usage_record &row = snapshot->m_rows.emplace_back();
+      row.m_type = index.type;
+      row.m_dir_name = index.dir;
+      row.m_file_name = file.name;
+      row.m_sequence = file.sequence;
+      row.m_size = file.size;
+      row.m_bytes_before = bytes_before;
+      row.m_growth_rate = {0, true};
+      row.m_is_stale = false;
+      bytes_before += file.size;
+    }
+    if (!index.files.empty())
+      snapshot->m_rows.back().m_growth_rate = index.rate;
+  }
+  log_usage_publisher.release(previous);
+
+  const std::vector<Disksize_log_usage_record> &rows = snapshot->m_rows;
+  snapshot->m_by_file_name.resize(rows.size());
+  for (unsigned int i = 0; i < rows.size(); i++)
+    snapshot->m_by_file_name[i] = i;
+  std::sort(snapshot->m_by_file_name.begin(), snapshot->m_by_file_name.end(),
+            [&rows](unsigned int a, unsigned int b) {
+              return rows[a].m_file_name < rows[b].m_file_name;
+            });
+
+  log_usage_publisher.publish(snapshot);
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_log_usage_st_share;
+
+typedef Disksize_snapshot_table<Disksize_log_usage_snapshot,
+                                Disksize_log_usage_record,
+                                Disksize_log_usage_Table_Handle>
+    Disksize_log_usage_table;
+
+int disksize_log_usage_index_init(PSI_table_handle *handle, unsigned int,
+                                  bool, PSI_index_handle **index)
+{
+  Disksize_log_usage_Table_Handle *h =
+      (Disksize_log_usage_Table_Handle *)handle;
+  Disksize_log_usage_index *i = &h->m_index;
+
+  i->m_handle = h;
+  i->m_file_name = {"FILE_NAME", 0, false, i->m_file_name_buffer, 0,
+                    sizeof(i->m_file_name_buffer)};
+  *index = (PSI_index_handle *)i;
+  return 0;
+}
+
+/*
+  An exact FILE_NAME is a binary search in the sorted row numbers, so the
+  space a purge frees is found in O(log n). Other lookups scan and filter.
+*/
+int disksize_log_usage_index_read(PSI_index_handle *index,
+                                  PSI_key_reader *reader, unsigned int,
+                                  int find_flag)
+{
+  Disksize_log_usage_index *i = (Disksize_log_usage_index *)index;
+  Disksize_log_usage_Table_Handle *h = i->m_handle;
+  const Disksize_log_usage_snapshot *snapshot = h->m_snapshot;
+  PSI_plugin_key_string *key = &i->m_file_name;
+
+  pfs_string->read_key_string(reader, key, find_flag);
+
+  h->m_index_cursor = 0;
+  h->m_index_end = 0;
+  if (snapshot == nullptr)
+    return 0;
+
+  const std::vector<unsigned int> &sorted_rows = snapshot->m_by_file_name;
+  h->m_index_end = sorted_rows.size();
+
+  if (key->m_find_flags == DISKSIZE_READ_KEY_EXACT && !key->m_is_null)
+  {
+    const std::vector<Disksize_log_usage_record> &rows = snapshot->m_rows;
+    std::string_view value(key->m_value_buffer, key->m_value_buffer_length);
+    auto first = std::lower_bound(
+        sorted_rows.begin(), sorted_rows.end(), value,
+        [&rows](unsigned int row, std::string_view key) {
+          return std::string_view(rows[row].m_file_name) < key;
+        });
+    auto last = std::upper_bound(
+        first, sorted_rows.end(), value,
+        [&rows](std::string_view key, unsigned int row) {
+          return key < std::string_view(rows[row].m_file_name);
+        });
+    h->m_index_cursor = first - sorted_rows.begin();
+    h->m_index_end = last - sorted_rows.begin();
+  }
+
+  return 0;
+}
+
+int disksize_log_usage_index_next(PSI_table_handle *handle)
+{
+  Disksize_log_usage_Table_Handle *h =
+      (Disksize_log_usage_Table_Handle *)handle;
+
+  if (h->m_snapshot == nullptr)
+    return PFS_HA_ERR_END_OF_FILE;
+
+  while (h->m_index_cursor < h->m_index_end)
+  {
+    unsigned int row = h->m_snapshot->m_by_file_name[h->m_index_cursor++];
+    const Disksize_log_usage_record *record = &h->m_snapshot->m_rows[row];
+
+    if (pfs_string->match_key_string(
+            false, record->m_file_name.data(),
+            (unsigned int)record->m_file_name.length(),
+            &h->m_index.m_file_name))
+    {
+      h->m_pos.set_at(row);
+      h->m_next_pos.set_after(&h->m_pos);
+      h->current_row = record;
+      h->m_rows_served++;
+      return 0;
+    }
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+static void read_log_usage_column(const Disksize_log_usage_record &row,
+                                  PSI_field *field, unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* LOG_TYPE */
+    pfs_enum->set(field, {row.m_type, false});
+    break;
+  case 1: /* DIR_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row.m_dir_name.data(),
+                                        (unsigned int)row.m_dir_name.length());
+    break;
+  case 2: /* FILE_NAME */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row.m_file_name.data(),
+        (unsigned int)row.m_file_name.length());
+    break;
+  case 3: /* SEQUENCE */
+    pfs_bigint->set_unsigned(field, {row.m_sequence, false});
+    break;
+  case 4: /* SIZE */
+    pfs_bigint->set_unsigned(field, {row.m_size, false});
+    break;
+  case 5: /* BYTES_BEFORE */
+    pfs_bigint->set_unsigned(field, {row.m_bytes_before, false});
+    break;
+  case 6: /* GROWTH_RATE */
+    pfs_double->set(field, row.m_growth_rate);
+    break;
+  case 7: /* IS_STALE */
+    pfs_enum->set(field, {row.m_is_stale ? DISKSIZE_ENUM_YES
+                                          : DISKSIZE_ENUM_NO,
+                          false});
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_log_usage_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_log_usage";
+  share->m_table_name_length = 15;
+  share->m_table_definition =
+      "LOG_TYPE enum('BINARY','RELAY','REDO') not null, "
+      "DIR_NAME varchar(255) not null, FILE_NAME varchar(255) not null, "
+      "SEQUENCE bigint unsigned not null, SIZE bigint unsigned not null, "
+      "BYTES_BEFORE bigint unsigned not null, GROWTH_RATE double, "
+      "IS_STALE enum('YES','NO') not null, KEY(FILE_NAME)";
+  Disksize_log_usage_table::init_share<&log_usage_publisher,
+                                       read_log_usage_column>(share);
+  share->m_proxy_engine_table.index_init = disksize_log_usage_index_init;
+  share->m_proxy_engine_table.index_read = disksize_log_usage_index_read;
+  share->m_proxy_engine_table.index_next = disksize_log_usage_index_next;
+}
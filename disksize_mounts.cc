@@ -0,0 +1,283 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+/*
+  DATA, only used by the collector
+*/
+
+/* Kept open: poll() on it reports the changes of the mount table */
+static int mountinfo_fd = -1;
+
+/* Content of /proc/self/mountinfo, the allocation is reused */
+static std::string mountinfo;
+
+/* Sorted on m_mount_point, one entry per mount point */
+static std::vector<Disksize_mount> mounts;
+
+/* Positions in mounts sorted on m_device_id, then on m_mount_point */
+static std::vector<unsigned int> mounts_by_device;
+
+static bool read_mountinfo()
+{
+  if (lseek(mountinfo_fd, 0, SEEK_SET) == -1)
+    return false;
+
+  mountinfo.clear();
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(mountinfo_fd, buffer, sizeof(buffer))) > 0)
+    mountinfo.append(buffer, n);
+  return n == 0;
+}
+
+/* Next blank separated token of line, empty at the end */
+static std::string_view next_token(std::string_view *line)
+{
+  size_t start = line->find_first_not_of(' ');
+  if (start == std::string_view::npos)
+  {
+    *line = std::string_view();
+    return *line;
+  }
+  size_t end = line->find(' ', start);
+  if (end == std::string_view::npos)
+    end = line->size();
+  std::string_view token = line->substr(start, end - start);
+  line->remove_prefix(end);
+  return token;
+}
+
+/* Blanks and backslashes are written as \ooo octal escapes */
+static std::string unescape(std::string_view token)
+{
+  std::string value;
+  value.reserve(token.size());
+  for (size_t i = 0; i < token.size(); i++)
+  {
+    if (token[i] == '\\' && i + 3 < token.size() &&
+        token[i + 1] >= '0' && token[i + 1] <= '3' &&
+        token[i + 2] >= '0' && token[i + 2] <= '7' &&
+        token[i + 3] >= '0' && token[i + 3] <= '7')
+    {
+      value += (char)(((token[i + 1] - '0') << 6) |
+                      ((token[i + 2] - '0') << 3) | (token[i + 3] - '0'));
+      i += 3;
+    }
+    else
+      value += token[i];
+  }
+  return value;
+}
+
+/* Per mount options, then the superblock ones not already listed */
+static std::string merge_options(std::string_view mount_options,
+                                 std::string_view super_options)
+{
+  std::string options(mount_options);
+  while (!super_options.empty())
+  {
+    size_t comma = super_options.find(',');
+    std::string_view option = super_options.substr(0, comma);
+    super_options.remove_prefix(comma == std::string_view::npos
+                                    ? super_options.size()
+                                    : comma + 1);
+
+    std::string_view listed(options);
+    bool found = false;
+    while (!listed.empty() && !found)
+    {
+      size_t end = listed.find(',');
+      found = (listed.substr(0, end) == option);
+      listed.remove_prefix(end == std::string_view::npos ? listed.size()
+                                                         : end + 1);
+    }
+    if (!found && !option.empty())
+    {
+      options += ',';
+      options += option;
+    }
+  }
+  return options;
+}
+
+/*
+  A line is
+    id parent major:minor root mount_point options [optional...] - type
+    source super_options
+  A mount point mounted over keeps the last entry, the visible one.
+*/
+static void parse_mountinfo()
+{
+  std::map<std::string, Disksize_mount> by_mount_point;
+  std::string_view remaining(mountinfo);
+
+  while (!remaining.empty())
+  {
+    size_t eol = remaining.find('\n');
+    std::string_view line = remaining.substr(0, eol);
+    remaining.remove_prefix(eol == std::string_view::npos ? remaining.size()
+                                                          : eol + 1);
+
+    next_token(&line); /* mount id */
+    next_token(&line); /* parent id */
+    std::string_view device = next_token(&line); /* major:minor */
+    next_token(&line); /* root */
+    std::string mount_point = unescape(next_token(&line));
+    std::string_view mount_options = next_token(&line);
+    std::string_view token;
+    do
+      token = next_token(&line);
+    while (!token.empty() && token != "-");
+    std::string_view fs_type = next_token(&line);
+    next_token(&line); /* source */
+    std::string_view super_options = next_token(&line);
+    unsigned int major, minor;
+    if (mount_point.empty() || fs_type.empty() ||
+        sscanf(std::string(device).c_str(), "%u:%u", &major, &minor) != 2)
+      continue;
+
+    Disksize_mount &mount = by_mount_point[mount_point];
+    mount.m_device_id = makedev(major, minor);
+    mount.m_mount_point = mount_point;
+    mount.m_fs_type = fs_type;
+    mount.m_options = merge_options(mount_options, super_options);
+  }
+
+  mounts.clear();
+  mounts.reserve(by_mount_point.size());
+  for (auto &entry : by_mount_point)
+    mounts.push_back(std::move(entry.second));
+
+  // mounts is sorted on the mount point, a stable sort keeps that order
+  mounts_by_device.resize(mounts.size());
+  for (unsigned int i = 0; i < mounts.size(); i++)
+    mounts_by_device[i] = i;
+  std::stable_sort(mounts_by_device.begin(), mounts_by_device.end(),
+                   [](unsigned int a, unsigned int b) {
+                     return mounts[a].m_device_id < mounts[b].m_device_id;
+                   });
+}
+
+bool disksize_mounts_refresh()
+{
+  if (mountinfo_fd == -1)
+  {
+    mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (mountinfo_fd == -1)
+      return false;
+    if (!read_mountinfo())
+      return false;
+    parse_mountinfo();
+    return true;
+  }
+
+  struct pollfd pfd = {mountinfo_fd, POLLPRI, 0};
+  if (poll(&pfd, 1, 0) <= 0 || (pfd.revents & (POLLPRI | POLLERR)) == 0 ||
+      !read_mountinfo())
+    return false;
+  parse_mountinfo();
+  return true;
+}
+
+void disksize_mounts_close()
+{
+  if (mountinfo_fd != -1)
+    close(mountinfo_fd);
+  mountinfo_fd = -1;
+  mounts.clear();
+  mounts_by_device.clear();
+}
+
+/* Longest mount point prefix of path, on '/' boundaries */
+static const Disksize_mount *mount_of_path(std::string_view path)
+{
+  if (path.empty() || path[0] != '/')
+    return nullptr;
+  while (path.size() > 1 && path.back() == '/')
+    path.remove_suffix(1);
+
+  for (;;)
+  {
+    auto found = std::lower_bound(
+        mounts.begin(), mounts.end(), path,
+        [](const Disksize_mount &mount, std::string_view key) {
+          return std::string_view(mount.m_mount_point) < key;
+        });
+    if (found != mounts.end() && found->m_mount_point == path)
+      return &*found;
+    if (path.size() == 1)
+      return nullptr;
+
+    size_t slash = path.rfind('/');
+    path = path.substr(0, slash == 0 ? 1 : slash);
+  }
+}
+
+/* True when path is mount_point or below it */
+static bool is_below(std::string_view path, std::string_view mount_point)
+{
+  if (path.size() < mount_point.size() ||
+      path.compare(0, mount_point.size(), mount_point) != 0)
+    return false;
+  return path.size() == mount_point.size() || mount_point == "/" ||
+         path[mount_point.size()] == '/';
+}
+
+const Disksize_mount *disksize_mount_of(unsigned long long device_id,
+                                        std::string_view path)
+{
+  auto first = std::lower_bound(
+      mounts_by_device.begin(), mounts_by_device.end(), device_id,
+      [](unsigned int mount, unsigned long long key) {
+        return mounts[mount].m_device_id < key;
+      });
+  if (first == mounts_by_device.end() ||
+      mounts[*first].m_device_id != device_id)
+    return mount_of_path(path);
+
+  // Bind mounts of the device: the longest mount point containing path
+  const Disksize_mount *found = &mounts[*first];
+  size_t found_length = 0;
+  while (path.size() > 1 && path.back() == '/')
+    path.remove_suffix(1);
+  for (auto it = first;
+       it != mounts_by_device.end() && mounts[*it].m_device_id == device_id;
+       ++it)
+  {
+    const Disksize_mount &mount = mounts[*it];
+    if (mount.m_mount_point.size() > found_length &&
+        is_below(path, mount.m_mount_point))
+    {
+      found = &mount;
+      found_length = mount.m_mount_point.size();
+    }
+  }
+  return found;
+}
@@ -0,0 +1,325 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+unsigned int disksize_page_cache_interval = DISKSIZE_DEFAULT_PAGE_CACHE_INTERVAL;
+unsigned int disksize_page_cache_scan_rate =
+    DISKSIZE_DEFAULT_PAGE_CACHE_SCAN_RATE;
+
+/* Values of enum('FILE','DIRECTORY') */
+#define DISKSIZE_PAGE_CACHE_FILE 1ULL
+#define DISKSIZE_PAGE_CACHE_DIRECTORY 2ULL
+
+/*
+  DATA
+*/
+
+static Disksize_publisher<Disksize_page_cache_snapshot> page_cache_publisher;
+
+static std::thread page_cache_thread;
+static std::mutex page_cache_mutex;
+static std::condition_variable page_cache_cond;
+static std::atomic<bool> page_cache_stop_requested{false};
+static bool page_cache_wakeup_requested = false;
+
+/* One byte per page of a chunk, reused for every mincore() call */
+static std::vector<unsigned char> residency;
+
+/*
+  Throttling: a pass checks at most disksize.page_cache_scan_rate MiB of
+  file per second, sleeping between chunks when it runs ahead.
+*/
+struct Page_cache_pass {
+  std::chrono::steady_clock::time_point started_at;
+  unsigned long long scanned{0};
+  size_t page_size;
+};
+
+/* False when the component is being stopped */
+static bool throttle(Page_cache_pass *pass, unsigned long long bytes)
+{
+  pass->scanned += bytes;
+  double rate = (double)disksize_page_cache_scan_rate * 1024 * 1024;
+  auto due = pass->started_at +
+             std::chrono::microseconds(
+                 (long long)(pass->scanned / rate * 1000000.0));
+
+  std::unique_lock<std::mutex> lock(page_cache_mutex);
+  page_cache_cond.wait_until(
+      lock, due, [] { return page_cache_stop_requested.load(); });
+  return !page_cache_stop_requested.load();
+}
+
+/* Resident bytes of a file, false when it could not be checked */
+static bool file_residency(Page_cache_pass *pass, int fd,
+                           unsigned long long size,
+                           unsigned long long *resident)
+{
+  *resident = 0;
+  for (unsigned long long offset = 0; offset < size;
+       offset += DISKSIZE_PAGE_CACHE_CHUNK)
+  {
+    size_t length = (size_t)std::min<unsigned long long>(
+        DISKSIZE_PAGE_CACHE_CHUNK, size - offset);
+    // Mapping only reserves addresses, no page is read nor faulted in
+    void *map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, offset);
+    if (map == MAP_FAILED)
+      return false;
+
+    size_t pages = (length + pass->page_size - 1) / pass->page_size;
+    bool ok = (mincore(map, length, residency.data()) == 0);
+    munmap(map, length);
+    if (!ok)
+      return false;
+
+    for (size_t i = 0; i < pages; i++)
+      if (residency[i] & 1)
+        *resident += pass->page_size;
+    if (*resident > size)
+      *resident = size;
+
+    if (!throttle(pass, length))
+      return false;
+  }
+  return true;
+}
+
+static void fill_sizes(Disksize_page_cache_record *row,
+                       unsigned long long size, unsigned long long resident)
+{
+  row->m_size = {size, false};
+  row->m_resident_size = {resident, false};
+  row->m_resident_pct = {size != 0 ? resident * 100.0 / size : 0, size == 0};
+}
+
+static void run_page_cache_pass()
+{
+  std::vector<Disksize_monitored_dir> dirs;
+  disksize_monitored_dirs(&dirs);
+  if (dirs.empty())
+    return;
+
+  Page_cache_pass pass;
+  pass.started_at = std::chrono::steady_clock::now();
+  pass.page_size = (size_t)sysconf(_SC_PAGESIZE);
+  residency.resize(DISKSIZE_PAGE_CACHE_CHUNK / pass.page_size + 1);
+
+  Disksize_page_cache_snapshot *snapshot = new Disksize_page_cache_snapshot;
+  std::vector<Disksize_page_cache_record> &rows = snapshot->m_rows;
+  size_t file_count = 0;
+
+  for (const Disksize_monitored_dir &dir : dirs)
+  {
+    DIR *dirp = opendir(dir.m_dir_name.c_str());
+    if (dirp == nullptr)
+      continue;
+
+    size_t dir_row = rows.size();
+    rows.push_back({dir.m_dir_name, dir.m_related_variable,
+                    DISKSIZE_PAGE_CACHE_DIRECTORY, {}, {}, {}});
+    unsigned long long dir_size = 0;
+    unsigned long long dir_resident = 0;
+
+    struct dirent *entry;
+    struct stat file_stat;
+    while ((entry = readdir(dirp)) != nullptr &&
+           file_count < DISKSIZE_PAGE_CACHE_MAX_FILES)
+    {
+      if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+        continue;
+      int fd = openat(dirfd(dirp), entry->d_name,
+                      O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+      if (fd == -1)
+        continue;
+
+      unsigned long long resident;
+      if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) &&
+          file_residency(&pass, fd, file_stat.st_size, &resident))
+      {
+        Disksize_page_cache_record &row = rows.emplace_back();
+        row.m_name = dir.m_dir_name;
+        if (row.m_name != "/")
+          row.m_name += '/';
+        row.m_name += entry->d_name;
+        row.m_related_variable = dir.m_related_variable;
+        row.m_type = DISKSIZE_PAGE_CACHE_FILE;
+        fill_sizes(&row, file_stat.st_size, resident);
+        dir_size += file_stat.st_size;
+        dir_resident += resident;
+        file_count++;
+      }
+      close(fd);
+
+      if (page_cache_stop_requested.load())
+      {
+        closedir(dirp);
+        delete snapshot;
+        return;
+      }
+    }
+    closedir(dirp);
+
+    fill_sizes(&rows[dir_row], dir_size, dir_resident);
+  }
+
+  page_cache_publisher.publish(snapshot);
+}
+
+/*
+  SCANNER thread
+*/
+
+static void page_cache_main()
+{
+  std::unique_lock<std::mutex> lock(page_cache_mutex);
+  while (!page_cache_stop_requested.load())
+  {
+    bool wait_for_snapshot = false;
+    if (disksize_page_cache_interval > 0)
+    {
+      lock.unlock();
+      Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+      wait_for_snapshot = (snapshot == nullptr);
+      disksize_snapshot_release(snapshot);
+      if (!wait_for_snapshot)
+        run_page_cache_pass();
+      lock.lock();
+    }
+
+    page_cache_wakeup_requested = false;
+    auto predicate = [] {
+      return page_cache_stop_requested.load() || page_cache_wakeup_requested;
+    };
+    if (wait_for_snapshot)
+      page_cache_cond.wait_for(lock, std::chrono::seconds(1), predicate);
+    else if (disksize_page_cache_interval == 0)
+      page_cache_cond.wait(lock, predicate);
+    else
+      page_cache_cond.wait_for(
+          lock, std::chrono::seconds(disksize_page_cache_interval), predicate);
+  }
+}
+
+bool disksize_page_cache_start()
+{
+  page_cache_publisher.init(&LOCK_disksize_data);
+  page_cache_stop_requested.store(false);
+  page_cache_wakeup_requested = false;
+  try
+  {
+    page_cache_thread = std::thread(page_cache_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the page cache thread");
+    return true;
+  }
+  return false;
+}
+
+void disksize_page_cache_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(page_cache_mutex);
+    page_cache_stop_requested.store(true);
+  }
+  page_cache_cond.notify_all();
+  if (page_cache_thread.joinable())
+    page_cache_thread.join();
+  page_cache_publisher.cleanup();
+  residency = std::vector<unsigned char>();
+}
+
+void disksize_page_cache_wakeup()
+{
+  {
+    std::lock_guard<std::mutex> lock(page_cache_mutex);
+    page_cache_wakeup_requested = true;
+  }
+  page_cache_cond.notify_all();
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_page_cache_st_share;
+
+typedef Disksize_snapshot_table<Disksize_page_cache_snapshot,
+                                Disksize_page_cache_record>
+    Disksize_page_cache_table;
+
+static void read_page_cache_column(const Disksize_page_cache_record &row,
+                                   PSI_field *field, unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* OBJECT_TYPE */
+    pfs_enum->set(field, {row.m_type, false});
+    break;
+  case 1: /* OBJECT_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row.m_name.data(),
+                                        (unsigned int)row.m_name.length());
+    break;
+  case 2: /* RELATED_VARIABLE */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row.m_related_variable.data(),
+        (unsigned int)row.m_related_variable.length());
+    break;
+  case 3: /* SIZE */
+    pfs_bigint->set_unsigned(field, row.m_size);
+    break;
+  case 4: /* RESIDENT_SIZE */
+    pfs_bigint->set_unsigned(field, row.m_resident_size);
+    break;
+  case 5: /* RESIDENT_PCT */
+    pfs_double->set(field, row.m_resident_pct);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_page_cache_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_page_cache";
+  share->m_table_name_length = 16;
+  share->m_table_definition =
+      "OBJECT_TYPE enum('FILE','DIRECTORY') not null, "
+      "OBJECT_NAME varchar(512) not null, "
+      "RELATED_VARIABLE varchar(60) not null, SIZE bigint unsigned, "
+      "RESIDENT_SIZE bigint unsigned, RESIDENT_PCT double";
+  Disksize_page_cache_table::init_share<&page_cache_publisher,
+                                        read_page_cache_column>(share);
+}
@@ -0,0 +1,228 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/*
+  disksize_parse_bench: cost of reading and parsing the server variables
+  at each full refresh of the collector, get_variable() being stubbed.
+
+  Usage: disksize_parse_bench [iterations]
+
+  Three loops are timed: the istringstream parser the collector used
+  before, which parsed every value at every refresh; the string_view
+  tokenizer of disksize_variables.cc when every value changed; and the
+  same when nothing changed, the steady state of a server.
+*/
+
+#include "components/disksize/disksize.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <tuple>
+
+REQUIRES_SERVICE_PLACEHOLDER(component_sys_variable_register);
+SERVICE_TYPE(log_builtins) * log_bi;
+SERVICE_TYPE(log_builtins_string) * log_bs;
+
+struct Bench_variable {
+  const char *name;
+  /* Two values, so that a refresh can see every value change */
+  const char *values[2];
+};
+
+static const Bench_variable bench_variables[] = {
+    {"log_bin_basename",
+     {"/var/lib/mysql/binlog", "/var/lib/mysql-bin/binlog"}},
+    {"relay_log_basename",
+     {"/var/lib/mysql/relay-bin", "/var/lib/mysql-relay/relay-bin"}},
+    {"datadir", {"/var/lib/mysql/", "/srv/mysql/data/"}},
+    {"tmpdir", {"/tmp;/var/tmp", "/mnt/tmp1;/mnt/tmp2"}},
+    {"innodb_undo_directory", {"./", "/srv/mysql/undo/"}},
+    {"innodb_data_home_dir", {"", "/srv/mysql/data/"}},
+    {"innodb_log_group_home_dir", {"./", "/srv/mysql/redo/"}},
+    {"innodb_temp_tablespaces_dir",
+     {"./#innodb_temp/", "/srv/mysql/temp/"}},
+    {"innodb_tmpdir", {"", "/srv/mysql/tmp"}},
+    {"innodb_redo_log_archive_dirs",
+     {"label1:/var/lib/archive1;label2:/var/lib/archive2",
+      "label1:/srv/archive1;label2:/srv/archive2"}},
+    {"replica_load_tmpdir", {"/tmp", "/var/tmp"}}};
+
+/* Which of the two values get_variable() returns */
+static int current_value = 0;
+
+static mysql_service_status_t bench_get_variable(const char *, const char *name,
+                                                 void **val, size_t *length)
+{
+  for (const Bench_variable &variable : bench_variables)
+  {
+    if (strcmp(variable.name, name) != 0)
+      continue;
+    const char *value = variable.values[current_value];
+    size_t value_length = strlen(value);
+    if (value_length + 1 > *length)
+    {
+      *length = value_length + 1;
+      return true;
+    }
+    memcpy(*val, value, value_length + 1);
+    *length = value_length;
+    return false;
+  }
+  return true;
+}
+
+/* The parser of the collector before the string_view tokenizer */
+static std::string legacy_path_name(const std::string &s)
+{
+  size_t i = s.rfind('/', s.length());
+  if (i != std::string::npos)
+    return s.substr(0, i);
+  return "";
+}
+
+static void legacy_split_labels(
+    const std::string &variable, const std::string &value,
+    std::vector<std::tuple<std::string, std::string>> *all_values_to_parse)
+{
+  std::istringstream list(value);
+  int loop = 0;
+  std::string label;
+  while (list)
+  {
+    std::string part;
+    std::getline(list, part, ':');
+    if (strlen(part.c_str()) > 0)
+    {
+      if (loop == 0)
+      {
+        label = variable + " (" + part + ")";
+        loop++;
+      }
+      else
+      {
+        loop--;
+        all_values_to_parse->push_back(make_tuple(label, part));
+      }
+    }
+  }
+}
+
+static void legacy_collect_all_values_to_parse(
+    std::vector<std::tuple<std::string, std::string>> *all_values_to_parse)
+{
+  char *value = nullptr;
+  char buffer_for_value[1024];
+  size_t value_length;
+
+  for (int i = 0; i < int(variables_to_parse.size()); i++)
+  {
+    value = &buffer_for_value[0];
+    value_length = sizeof(buffer_for_value) - 1;
+
+    const char *var_to_get = variables_to_parse[i].c_str();
+
+    if (mysql_service_component_sys_variable_register->get_variable(
+            "mysql_server", var_to_get, (void **)&value, &value_length))
+      continue;
+    if (strlen(value) > 0)
+    {
+      std::string path;
+      path = value;
+      if (strcmp(var_to_get, "log_bin_basename") == 0)
+        path = legacy_path_name(value);
+      if (path.find(';') != std::string::npos)
+      {
+        std::istringstream list(path);
+        while (list)
+        {
+          std::string pathpart;
+          std::getline(list, pathpart, ';');
+          if (strlen(pathpart.c_str()) > 0)
+          {
+            if (pathpart.find(':') != std::string::npos)
+              legacy_split_labels(variables_to_parse[i], pathpart,
+                                  all_values_to_parse);
+            else
+              all_values_to_parse->push_back(make_tuple(var_to_get, pathpart));
+          }
+        }
+      }
+      else if (path.find(':') != std::string::npos)
+        legacy_split_labels(variables_to_parse[i], path, all_values_to_parse);
+      else
+        all_values_to_parse->push_back(make_tuple(var_to_get, path));
+    }
+  }
+}
+
+static size_t parsed_path_count()
+{
+  size_t count = 0;
+  for (const Disksize_parsed_variable &parsed : disksize_parsed_variables())
+    count += parsed.paths.size();
+  return count;
+}
+
+template <class F>
+static void run(const char *name, unsigned long iterations, F f)
+{
+  size_t paths = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++)
+    paths += f(i);
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  printf("%-40s %10.1f ns per refresh, %zu paths per refresh\n", name,
+         (double)elapsed.count() / iterations, paths / iterations);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long iterations = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 0;
+  if (iterations == 0)
+    iterations = 100000;
+
+  static SERVICE_TYPE_NO_CONST(component_sys_variable_register) service;
+  service.get_variable = bench_get_variable;
+  mysql_service_component_sys_variable_register = &service;
+
+  run("istringstream, every refresh", iterations, [](unsigned long i) {
+    std::vector<std::tuple<std::string, std::string>> all_values_to_parse;
+    current_value = (int)(i & 1);
+    legacy_collect_all_values_to_parse(&all_values_to_parse);
+    return all_values_to_parse.size();
+  });
+
+  run("string_view, every value changed", iterations, [](unsigned long i) {
+    current_value = (int)(i & 1);
+    disksize_refresh_parsed_variables();
+    return parsed_path_count();
+  });
+
+  current_value = 0;
+  disksize_refresh_parsed_variables();
+  run("string_view, steady state", iterations, [](unsigned long) {
+    disksize_refresh_parsed_variables();
+    return parsed_path_count();
+  });
+
+  return 0;
+}
@@ -18,141 +18,36 @@
 
 #include "components/disksize/disksize.h"
 
-#include <array>
-#include <sstream>
+#include <algorithm>
+#include <string_view>
 
 #define LOG_COMPONENT_TAG "disksize"
 
 REQUIRES_SERVICE_PLACEHOLDER(pfs_plugin_table_v1);
 REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_bigint_v1, pfs_bigint);
 REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_string_v2, pfs_string);
-
-static char *disksize_file_value;
-
-// Declaration: Array of all variables we should parse
-std::vector<std::string> variables_to_parse{
-    "log_bin_basename",
-    "datadir",
-    "tmpdir",
-    "innodb_undo_directory",
-    "innodb_data_home_dir",
-    "innodb_log_group_home_dir",
-    "innodb_temp_tablespaces_dir",
-    "innodb_tmpdir",
-    "innodb_redo_log_archive_dirs",
-    "replica_load_tmpdir"};
-
-std::string getPathName(const std::string &s)
-{
-
-  char sep = '/';
-
-#ifdef _WIN32
-  sep = '\\';
-#endif
-
-  size_t i = s.rfind(sep, s.length());
-  if (i != std::string::npos)
-  {
-    return (s.substr(0, i));
-  }
-
-  return ("");
-}
-
-/*
-  DATA
-*/
-
-static std::array<Disksize_record *, DISKSIZE_MAX_ROWS> disksize_array;
-
-/* Next available index for new record to be stored in global record array. */
-static size_t disksize_next_available_index = 0;
-
-class MutexGuard {
- private:
-  mysql_mutex_t *m_mutex{nullptr};
-
- public:
-  MutexGuard(mysql_mutex_t *mutex) : m_mutex(mutex) {
-    mysql_mutex_lock(m_mutex);
-  }
-  ~MutexGuard() { mysql_mutex_unlock(m_mutex); }
-};
-
-void init_disksize_data()
-{
-  MutexGuard guard(&LOCK_disksize_data);
-  disksize_next_available_index = 0;
-  disksize_array.fill(nullptr);
-}
-
-void cleanup_disksize_data()
-{
-  MutexGuard guard(&LOCK_disksize_data);
-  for (Disksize_record *disksize : disksize_array)
-    delete disksize;
-}
-
-/*
-  DATA collection
-*/
-
-void addDisksize_element(std::string disksize_dir_name,
-                         std::string disksize_related_variable,
-                         PSI_ulonglong disksize_free_size,
-                         PSI_ulonglong disksize_total_size)
-{
-  size_t index;
-  Disksize_record *record;
-
-  MutexGuard guard(&LOCK_disksize_data);
-
-  index = disksize_next_available_index++ % DISKSIZE_MAX_ROWS;
-  record = disksize_array[index];
-
-  if (record != nullptr)
-    delete record;
-
-  record = new Disksize_record;
-  record->disksize_dir_name = disksize_dir_name;
-  record->disksize_related_variable = disksize_related_variable;
-  record->disksize_dir_size_free = disksize_free_size;
-  record->disksize_dir_size_total = disksize_total_size;
-
-  disksize_array[index] = record;
-}
+REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_enum_v1, pfs_enum);
+REQUIRES_SERVICE_PLACEHOLDER_AS(pfs_plugin_column_double_v1, pfs_double);
 
 /*
   DATA access (performance schema table)
 */
 
 /* Collection of table shares to be added to performance schema */
-PFS_engine_table_share_proxy *share_list[1] = {nullptr};
-unsigned int share_list_count = 1;
+PFS_engine_table_share_proxy *share_list[12] = {
+    nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+unsigned int share_list_count = 12;
 
 /* Global share pointer for a table */
 PFS_engine_table_share_proxy disksize_st_share;
 
-int disksize_delete_all_rows(void)
-{
-  cleanup_disksize_data();
-  return 0;
-}
-
 PSI_table_handle *disksize_open_table(PSI_pos **pos)
 {
-  disksize_file_value = nullptr;
-  char *value = nullptr;
-  char buffer_for_value[1024];
-  size_t value_length;
-  char msgbuf[1024];
-  std::vector<std::tuple<std::string, std::string>> all_values_to_parse;
-
-  init_disksize_data();
   MYSQL_THD thd;
-  disksize_delete_all_rows();
+  Disksize_Table_Handle *temp = new Disksize_Table_Handle();
 
+  disksize_count_table_open();
   mysql_service_mysql_current_thread_reader->get(&thd);
   if (!have_required_privilege(thd))
   {
@@ -162,142 +57,10 @@ PSI_table_handle *disksize_open_table(PSI_pos **pos)
   }
   else
   {
-    for (int i = 0; i < int(variables_to_parse.size()); i++)
-    {
-      value = &buffer_for_value[0];
-      value_length = sizeof(buffer_for_value) - 1;
-
-      const char *var_to_get = variables_to_parse.operator[](i).c_str();
-
-      if (mysql_service_component_sys_variable_register->get_variable(
-              "mysql_server", var_to_get, (void **)&value, &value_length))
-      {
-        sprintf(msgbuf, "Could not get value of variable [%s]", var_to_get);
-        LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
-        continue;
-      }
-      if (strlen(value) > 0)
-      {
-        std::string path;
-        path = value;
-        // Let's check if we are looking for log_bin_basename
-        if (strcmp(var_to_get, "log_bin_basename") == 0)
-        {
-          path = getPathName(value);
-        }
-        if (path.find(';') != std::string::npos)
-        {
-          // we found ';' in the value, this means multiple
-          // paths may be included in this variable
-          std::istringstream list(path);
-          while (list)
-          {
-            std::string pathpart;
-            std::getline(list, pathpart, ';');
-            if (strlen(pathpart.c_str()) > 0)
-            {
-              // we have an entry
-              // we need to check if there is a ':' in the value
-              if (pathpart.find(':') != std::string::npos)
-              {
-                // we found ':' in the split value too, we need then
-                // to split it once again, this is especially for
-                // innodb_redo_log_archive_dirs and labels
-                std::istringstream list2(pathpart);
-                int loop = 0;
-                std::string label;
-                while (list2)
-                {
-                  std::string labelpath;
-                  std::getline(list2, labelpath, ':');
-                  if (strlen(labelpath.c_str()) > 0)
-                  {
-                    // we have a label and a part
-                    if (loop == 0)
-                    {
-                      // we have a label
-                      // we concat the variable name + the label
-                      label = variables_to_parse.operator[](i) + " (" + labelpath + ")";
-                      loop++;
-                    }
-                    else
-                    {
-                      // we have a path
-                      loop--;
-                      all_values_to_parse.push_back(make_tuple(label, labelpath));
-                    }
-                  }
-                }
-              }
-              else
-              {
-                // we have some path delimited by ';'
-                all_values_to_parse.push_back(make_tuple(var_to_get, pathpart));
-              }
-            }
-          }
-        }
-        else if (path.find(':') != std::string::npos) {
-          // we don't have any ';' but we have one entry with a label (':')
-          std::istringstream list(path);
-          int loop = 0;
-          std::string label;
-          while (list)
-          {
-            std::string pathpart;
-            std::getline(list, pathpart, ':');
-            if (strlen(pathpart.c_str()) > 0)
-            {
-                // we have a label and a part
-                if (loop == 0)
-                {
-                  // we have a label
-                  // we concat the variable name + the label
-                  label = variables_to_parse.operator[](i) + " (" + pathpart + ")";
-                  loop++;
-                }
-                else
-                {
-                  // we have a path
-                  loop--;
-                  all_values_to_parse.push_back(make_tuple(label, pathpart));
-                }
-            }
-          }
-        } else {
-          all_values_to_parse.push_back(make_tuple(var_to_get, path));
-        }
-      }
-    }
-      long long unsigned int size;
-      long long unsigned int free;
-      struct statvfs buf;
-      int j = 0;
-      for (int i = 0; i < int(all_values_to_parse.size()); i++)
-      {
-        std::tuple info_to_get = all_values_to_parse.operator[](i);
-        // Now let's get the info from disk
-        if (statvfs(std::get<1>(info_to_get).c_str(), &buf) == -1)
-        {
-          sprintf(msgbuf, "OS File access problem to %s", std::get<1>(info_to_get).c_str());
-          LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
-          continue;
-        }
-        size = (long long unsigned int)buf.f_blocks * buf.f_bsize;
-        free = (long long unsigned int)buf.f_bavail * buf.f_bsize;
-
-        PSI_ubigint psi_size_free;
-        PSI_ubigint psi_size_total;
-
-        psi_size_free = {free, false};
-        psi_size_total = {size, false};
-
-        addDisksize_element(std::get<1>(info_to_get), std::get<0>(info_to_get), psi_size_free, psi_size_total);
-        j++;
-      }
-    
+    // The collector thread did all the work, we only pin its last snapshot
+    temp->m_snapshot = disksize_snapshot_acquire();
   }
-  Disksize_Table_Handle *temp = new Disksize_Table_Handle();
+
   *pos = (PSI_pos *)(&temp->m_pos);
 
   return (PSI_table_handle *)temp;
@@ -306,18 +69,11 @@ PSI_table_handle *disksize_open_table(PSI_pos **pos)
 void disksize_close_table(PSI_table_handle *handle)
 {
   Disksize_Table_Handle *temp = (Disksize_Table_Handle *)handle;
+  disksize_count_rows_served(temp->m_rows_served);
+  disksize_snapshot_release(temp->m_snapshot);
   delete temp;
 }
 
-static void copy_record_disksize(Disksize_record *dest, const Disksize_record *source)
-{
-  dest->disksize_dir_name = source->disksize_dir_name;
-  dest->disksize_related_variable = source->disksize_related_variable;
-  dest->disksize_dir_size_free = source->disksize_dir_size_free;
-  dest->disksize_dir_size_total = source->disksize_dir_size_total;
-  return;
-}
-
 /* Define implementation of PFS_engine_table_proxy. */
 int disksize_rnd_next(PSI_table_handle *handle)
 {
@@ -325,16 +81,13 @@ int disksize_rnd_next(PSI_table_handle *handle)
   h->m_pos.set_at(&h->m_next_pos);
   size_t index = h->m_pos.get_index();
 
-  if (index < disksize_array.size())
+  if (h->m_snapshot != nullptr && index < h->m_snapshot->m_rows.size())
   {
-    Disksize_record *record = disksize_array[index];
-    if (record != nullptr)
-    {
-      /* Make the current row from records_array buffer */
-      copy_record_disksize(&h->current_row, record);
-      h->m_next_pos.set_after(&h->m_pos);
-      return 0;
-    }
+    /* The current row is read in place from the pinned snapshot */
+    h->current_row = &h->m_snapshot->m_rows[index];
+    h->m_next_pos.set_after(&h->m_pos);
+    h->m_rows_served++;
+    return 0;
   }
 
   return PFS_HA_ERR_END_OF_FILE;
@@ -348,15 +101,10 @@ int disksize_rnd_pos(PSI_table_handle *handle)
   Disksize_Table_Handle *h = (Disksize_Table_Handle *)handle;
   size_t index = h->m_pos.get_index();
 
-  if (index < disksize_array.size())
+  if (h->m_snapshot != nullptr && index < h->m_snapshot->m_rows.size())
   {
-    Disksize_record *record = disksize_array[index];
-
-    if (record != nullptr)
-    {
-      /* Make the current row from records_array buffer */
-      copy_record_disksize(&h->current_row, record);
-    }
+    /* The current row is read in place from the pinned snapshot */
+    h->current_row = &h->m_snapshot->m_rows[index];
   }
 
   return 0;
@@ -368,30 +116,209 @@ void disksize_reset_position(PSI_table_handle *handle)
   Disksize_Table_Handle *h = (Disksize_Table_Handle *)handle;
   h->m_pos.reset();
   h->m_next_pos.reset();
+  h->current_row = nullptr;
   return;
 }
 
+/* Prepare an index scan on PRIMARY (0) or RELATED_VARIABLE (1) */
+int disksize_index_init(PSI_table_handle *handle, unsigned int idx, bool,
+                        PSI_index_handle **index)
+{
+  Disksize_Table_Handle *h = (Disksize_Table_Handle *)handle;
+  Disksize_index *i = &h->m_index;
+
+  h->index_num = idx;
+  i->m_handle = h;
+  i->m_dir_name = {"DIR_NAME", 0, false, i->m_dir_name_buffer, 0,
+                   sizeof(i->m_dir_name_buffer)};
+  i->m_related_variable = {"RELATED_VARIABLE", 0, false,
+                           i->m_related_variable_buffer, 0,
+                           sizeof(i->m_related_variable_buffer)};
+  *index = (PSI_index_handle *)i;
+  return 0;
+}
+
+static bool disksize_key_is_exact(const PSI_plugin_key_string *key)
+{
+  return key->m_find_flags == DISKSIZE_READ_KEY_EXACT && !key->m_is_null;
+}
+
+static bool disksize_key_match(std::string_view value,
+                               PSI_plugin_key_string *key)
+{
+  return pfs_string->match_key_string(false, value.data(),
+                                      (unsigned int)value.length(), key);
+}
+
+static std::string_view disksize_dir_name_of(const Disksize_record &record)
+{
+  return record.disksize_dir_name.view();
+}
+
+static std::string_view disksize_related_variable_of(
+    const Disksize_record &record)
+{
+  return record.disksize_related_variable.view();
+}
+
+/*
+  Read the key values and narrow the scan to the matching range of the
+  sorted row numbers. An exact value on the first key part is a binary
+  search, anything else scans the whole index and filters in index_next.
+*/
+int disksize_index_read(PSI_index_handle *index, PSI_key_reader *reader,
+                        unsigned int idx, int find_flag)
+{
+  Disksize_index *i = (Disksize_index *)index;
+  Disksize_Table_Handle *h = i->m_handle;
+  const Disksize_snapshot *snapshot = h->m_snapshot;
+  const std::vector<unsigned int> *sorted_rows;
+  PSI_plugin_key_string *first_key;
+  std::string_view (*first_column)(const Disksize_record &);
+
+  switch (idx)
+  {
+  case 0: /* PRIMARY KEY(DIR_NAME, RELATED_VARIABLE) */
+    pfs_string->read_key_string(reader, &i->m_dir_name, find_flag);
+    pfs_string->read_key_string(reader, &i->m_related_variable, find_flag);
+    first_key = &i->m_dir_name;
+    first_column = disksize_dir_name_of;
+    break;
+  case 1: /* KEY(RELATED_VARIABLE) */
+    pfs_string->read_key_string(reader, &i->m_related_variable, find_flag);
+    first_key = &i->m_related_variable;
+    first_column = disksize_related_variable_of;
+    break;
+  default: /* We should never reach here */
+    return PFS_HA_ERR_END_OF_FILE;
+  }
+
+  h->m_index_rows = nullptr;
+  h->m_index_cursor = 0;
+  h->m_index_end = 0;
+  if (snapshot == nullptr)
+    return 0;
+
+  sorted_rows = (idx == 0) ? &snapshot->m_by_dir_name
+                           : &snapshot->m_by_related_variable;
+  h->m_index_rows = sorted_rows;
+  h->m_index_end = sorted_rows->size();
+
+  if (disksize_key_is_exact(first_key))
+  {
+    const std::vector<Disksize_record> &rows = snapshot->m_rows;
+    std::string_view value(first_key->m_value_buffer,
+                           first_key->m_value_buffer_length);
+    auto first = std::lower_bound(
+        sorted_rows->begin(), sorted_rows->end(), value,
+        [&rows, first_column](unsigned int row, std::string_view key) {
+          return first_column(rows[row]) < key;
+        });
+    auto last = std::upper_bound(
+        first, sorted_rows->end(), value,
+        [&rows, first_column](std::string_view key, unsigned int row) {
+          return key < first_column(rows[row]);
+        });
+    h->m_index_cursor = first - sorted_rows->begin();
+    h->m_index_end = last - sorted_rows->begin();
+  }
+
+  return 0;
+}
+
+int disksize_index_next(PSI_table_handle *handle)
+{
+  Disksize_Table_Handle *h = (Disksize_Table_Handle *)handle;
+  Disksize_index *i = &h->m_index;
+
+  if (h->m_index_rows == nullptr)
+    return PFS_HA_ERR_END_OF_FILE;
+
+  while (h->m_index_cursor < h->m_index_end)
+  {
+    unsigned int row = (*h->m_index_rows)[h->m_index_cursor++];
+    const Disksize_record *record = &h->m_snapshot->m_rows[row];
+    bool match;
+
+    if (h->index_num == 0)
+      match = disksize_key_match(record->disksize_dir_name.view(),
+                                 &i->m_dir_name) &&
+              disksize_key_match(record->disksize_related_variable.view(),
+                                 &i->m_related_variable);
+    else
+      match = disksize_key_match(record->disksize_related_variable.view(),
+                                 &i->m_related_variable);
+
+    if (match)
+    {
+      h->m_pos.set_at(row);
+      h->m_next_pos.set_after(&h->m_pos);
+      h->current_row = record;
+      h->m_rows_served++;
+      return 0;
+    }
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
 /* Read current row from the current_row and display them in the table */
 int disksize_read_column_value(PSI_table_handle *handle, PSI_field *field,
                                unsigned int index)
 {
   Disksize_Table_Handle *h = (Disksize_Table_Handle *)handle;
+  const Disksize_record *row = h->current_row;
+
+  if (row == nullptr)
+    return 0;
 
   switch (index)
   {
   case 0: /* DIR_NAME */
-    pfs_string->set_varchar_utf8mb4(
-        field, h->current_row.disksize_dir_name.c_str());
+    pfs_string->set_varchar_utf8mb4_len(field, row->disksize_dir_name.m_data,
+                                        row->disksize_dir_name.m_length);
     break;
   case 1: /* RELATED_VARIABLE */
-    pfs_string->set_varchar_utf8mb4(
-        field, h->current_row.disksize_related_variable.c_str());
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row->disksize_related_variable.m_data,
+        row->disksize_related_variable.m_length);
     break;
   case 2: /* FREE_SIZE */
-    pfs_bigint->set_unsigned(field, h->current_row.disksize_dir_size_free);
+    pfs_bigint->set_unsigned(field, row->disksize_dir_size_free);
     break;
   case 3: /* TOTAL_SIZE */
-    pfs_bigint->set_unsigned(field, h->current_row.disksize_dir_size_total);
+    pfs_bigint->set_unsigned(field, row->disksize_dir_size_total);
+    break;
+  case 4: /* DEVICE_ID */
+    pfs_bigint->set_unsigned(field, row->disksize_device_id);
+    break;
+  case 5: /* MOUNT_POINT */
+    pfs_string->set_varchar_utf8mb4_len(field,
+                                        row->disksize_mount_point.m_data,
+                                        row->disksize_mount_point.m_length);
+    break;
+  case 6: /* FILL_RATE */
+    pfs_bigint->set(field, row->disksize_fill_rate);
+    break;
+  case 7: /* SECONDS_TO_FULL */
+    pfs_bigint->set_unsigned(field, row->disksize_seconds_to_full);
+    break;
+  case 8: /* SAMPLED_AT */
+    pfs_timestamp->set2(field, row->disksize_sampled_at);
+    break;
+  case 9: /* IS_STALE */
+    pfs_enum->set(field, {row->disksize_is_stale ? DISKSIZE_ENUM_YES
+                                                 : DISKSIZE_ENUM_NO,
+                          false});
+    break;
+  case 10: /* FS_TYPE */
+    pfs_string->set_varchar_utf8mb4_len(field, row->disksize_fs_type.m_data,
+                                        row->disksize_fs_type.m_length);
+    break;
+  case 11: /* MOUNT_OPTIONS */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row->disksize_mount_options.m_data,
+        row->disksize_mount_options.m_length);
     break;
   default: /* We should never reach here */
     // assert(0);
@@ -400,7 +327,13 @@ int disksize_read_column_value(PSI_table_handle *handle, PSI_field *field,
   return 0;
 }
 
-unsigned long long disksize_get_row_count(void) { return DISKSIZE_MAX_ROWS; }
+unsigned long long disksize_get_row_count(void)
+{
+  Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+  unsigned long long count = (snapshot != nullptr) ? snapshot->m_rows.size() : 0;
+  disksize_snapshot_release(snapshot);
+  return count;
+}
 
 void init_disksize_share(PFS_engine_table_share_proxy *share)
 {
@@ -409,7 +342,12 @@ void init_disksize_share(PFS_engine_table_share_proxy *share)
   share->m_table_name_length = 10;
   share->m_table_definition =
       "DIR_NAME varchar(255) not null, RELATED_VARIABLE varchar(60) not null, "
-      "FREE_SIZE bigint unsigned, TOTAL_SIZE bigint unsigned, PRIMARY KEY(DIR_NAME)";
+      "FREE_SIZE bigint unsigned, TOTAL_SIZE bigint unsigned, "
+      "DEVICE_ID bigint unsigned, MOUNT_POINT varchar(255), "
+      "FILL_RATE bigint, SECONDS_TO_FULL bigint unsigned, "
+      "SAMPLED_AT timestamp(6) not null, IS_STALE enum('YES','NO') not null, "
+      "FS_TYPE varchar(32), MOUNT_OPTIONS varchar(255), "
+      "PRIMARY KEY(DIR_NAME, RELATED_VARIABLE), KEY(RELATED_VARIABLE)";
   share->m_ref_length = sizeof(Disksize_POS);
   share->m_acl = READONLY;
   share->get_row_count = disksize_get_row_count;
@@ -417,7 +355,8 @@ void init_disksize_share(PFS_engine_table_share_proxy *share)
 
   /* Initialize PFS_engine_table_proxy */
   share->m_proxy_engine_table = {disksize_rnd_next, disksize_rnd_init, disksize_rnd_pos,
-                                 nullptr, nullptr, nullptr,
+                                 disksize_index_init, disksize_index_read,
+                                 disksize_index_next,
                                  disksize_read_column_value, disksize_reset_position,
                                  /* READONLY TABLE */
                                  nullptr, /* write_column_value */
@@ -0,0 +1,178 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+unsigned int disksize_probe_threads = DISKSIZE_DEFAULT_PROBE_THREADS;
+unsigned int disksize_probe_timeout = DISKSIZE_DEFAULT_PROBE_TIMEOUT;
+
+/*
+  POOL
+
+  Probes are shared between the pool and the caller: a probe the caller
+  stopped waiting for stays alive until its worker is done with it.
+*/
+
+static std::vector<std::thread> probe_workers;
+static std::mutex probe_mutex;
+/* Signaled when a probe is queued, or when the pool is stopped */
+static std::condition_variable probe_queued_cond;
+/* Signaled when a probe is done */
+static std::condition_variable probe_done_cond;
+static std::deque<std::shared_ptr<Disksize_probe>> probe_queue;
+static bool probe_stop_requested = false;
+/* Workers waiting for a probe, the others run one or are stuck in it */
+static unsigned int probe_idle_workers = 0;
+
+static void probe_worker_main()
+{
+  std::unique_lock<std::mutex> lock(probe_mutex);
+  while (true)
+  {
+    probe_idle_workers++;
+    probe_queued_cond.wait(
+        lock, [] { return probe_stop_requested || !probe_queue.empty(); });
+    probe_idle_workers--;
+    if (probe_stop_requested)
+      break;
+
+    std::shared_ptr<Disksize_probe> probe = std::move(probe_queue.front());
+    probe_queue.pop_front();
+    probe->m_started.store(true, std::memory_order_release);
+    lock.unlock();
+
+    // This is where a hung mount blocks, only this worker is held
+    unsigned long long started_at = disksize_now_ns();
+    probe->run();
+    probe->m_latency = disksize_now_ns() - started_at;
+
+    lock.lock();
+    probe->m_done.store(true, std::memory_order_release);
+    probe_done_cond.notify_all();
+  }
+}
+
+/*
+  Workers blocked on a hung mount are not available to the other probes:
+  extra workers are started so that up to disksize.probe_threads queued
+  probes find an idle one, at most DISKSIZE_MAX_EXTRA_PROBE_THREADS of
+  them. Called with probe_mutex held.
+*/
+static void add_probe_workers()
+{
+  size_t wanted =
+      std::min(probe_queue.size(), (size_t)disksize_probe_threads);
+  // New workers count themselves as idle once they get probe_mutex
+  for (size_t started = 0;
+       probe_idle_workers + started < wanted &&
+       probe_workers.size() <
+           disksize_probe_threads + DISKSIZE_MAX_EXTRA_PROBE_THREADS;
+       started++)
+  {
+    try
+    {
+      probe_workers.emplace_back(probe_worker_main);
+    }
+    catch (const std::system_error &)
+    {
+      return;
+    }
+  }
+}
+
+bool disksize_probe_pool_start()
+{
+  probe_stop_requested = false;
+  probe_idle_workers = 0;
+  try
+  {
+    for (unsigned int i = 0; i < disksize_probe_threads; i++)
+      probe_workers.emplace_back(probe_worker_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the probe threads");
+    disksize_probe_pool_stop();
+    return true;
+  }
+  return false;
+}
+
+/*
+  Workers blocked in a system call are joined when it returns: uninstalling
+  the component waits for them rather than unloading code they still run.
+*/
+void disksize_probe_pool_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    probe_stop_requested = true;
+    probe_queue.clear();
+  }
+  probe_queued_cond.notify_all();
+  for (std::thread &worker : probe_workers)
+    worker.join();
+  probe_workers.clear();
+}
+
+void disksize_probe_run(
+    const std::vector<std::shared_ptr<Disksize_probe>> &probes,
+    unsigned int timeout_ms)
+{
+  if (probes.empty())
+    return;
+
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+  std::unique_lock<std::mutex> lock(probe_mutex);
+  for (const std::shared_ptr<Disksize_probe> &probe : probes)
+    probe_queue.push_back(probe);
+  add_probe_workers();
+  probe_queued_cond.notify_all();
+
+  probe_done_cond.wait_until(lock, deadline, [&probes] {
+    for (const std::shared_ptr<Disksize_probe> &probe : probes)
+      if (!probe->is_done())
+        return false;
+    return true;
+  });
+
+  // Probes not started yet are not worth running anymore, they stay not
+  // started and not done
+  for (auto it = probe_queue.begin(); it != probe_queue.end();)
+  {
+    bool abandoned = false;
+    for (const std::shared_ptr<Disksize_probe> &probe : probes)
+      if (*it == probe)
+        abandoned = true;
+    if (abandoned)
+      it = probe_queue.erase(it);
+    else
+      ++it;
+  }
+}
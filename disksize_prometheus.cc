@@ -0,0 +1,300 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+char *disksize_prometheus_dir = nullptr;
+unsigned int disksize_prometheus_interval =
+    DISKSIZE_DEFAULT_PROMETHEUS_INTERVAL;
+
+/*
+  DATA, only used by the exporter thread
+*/
+
+static std::thread prometheus_thread;
+static std::mutex prometheus_mutex;
+static std::condition_variable prometheus_cond;
+static std::atomic<bool> prometheus_stop_requested{false};
+static bool prometheus_wakeup_requested = false;
+
+/* Output buffer, it keeps its size so a steady export does not allocate */
+static std::vector<char> output(DISKSIZE_PROMETHEUS_BUFFER_SIZE);
+static size_t output_length = 0;
+
+static std::string prometheus_file;
+static std::string prometheus_temp_file;
+/* Only the first of consecutive failures is logged */
+static bool prometheus_failing = false;
+
+static void append(const char *format, ...)
+{
+  for (;;)
+  {
+    va_list args;
+    va_start(args, format);
+    size_t room = output.size() - output_length;
+    int length = vsnprintf(output.data() + output_length, room, format, args);
+    va_end(args);
+    if (length < 0)
+      return;
+    if ((size_t)length < room)
+    {
+      output_length += length;
+      return;
+    }
+    output.resize(std::max(output.size() * 2, output_length + length + 1));
+  }
+}
+
+static void append_char(char c)
+{
+  if (output_length == output.size())
+    output.resize(output.size() * 2);
+  output[output_length++] = c;
+}
+
+/* A label value, with \, " and newlines escaped */
+static void append_label(const char *name, std::string_view value)
+{
+  append("%s=\"", name);
+  for (char c : value)
+  {
+    if (c == '\\' || c == '"')
+      append_char('\\');
+    if (c == '\n')
+    {
+      append_char('\\');
+      c = 'n';
+    }
+    append_char(c);
+  }
+  append_char('"');
+}
+
+static void append_row_labels(const Disksize_record &row)
+{
+  append("{");
+  append_label("dir_name", row.disksize_dir_name.view());
+  append(",");
+  append_label("related_variable", row.disksize_related_variable.view());
+  append("}");
+}
+
+typedef unsigned long long (*Row_value)(const Disksize_record &row);
+
+static void append_gauge(const Disksize_snapshot *snapshot, const char *name,
+                         const char *help, Row_value value)
+{
+  append("# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+  for (const Disksize_record &row : snapshot->m_rows)
+  {
+    append("%s", name);
+    append_row_labels(row);
+    append(" %llu\n", value(row));
+  }
+}
+
+static void render(const Disksize_snapshot *snapshot)
+{
+  output_length = 0;
+
+  if (snapshot != nullptr)
+  {
+    append_gauge(snapshot, "mysql_disksize_free_bytes",
+                 "Bytes available on the filesystem of a directory.",
+                 [](const Disksize_record &row) {
+                   return row.disksize_dir_size_free.val;
+                 });
+    append_gauge(snapshot, "mysql_disksize_total_bytes",
+                 "Size of the filesystem of a directory.",
+                 [](const Disksize_record &row) {
+                   return row.disksize_dir_size_total.val;
+                 });
+    append_gauge(snapshot, "mysql_disksize_stale",
+                 "1 when the filesystem did not answer the last probe.",
+                 [](const Disksize_record &row) {
+                   return (unsigned long long)row.disksize_is_stale;
+                 });
+    append("# HELP mysql_disksize_sampled_at_seconds Time of the last "
+           "sample.\n# TYPE mysql_disksize_sampled_at_seconds gauge\n"
+           "mysql_disksize_sampled_at_seconds %llu.%06llu\n",
+           snapshot->m_sampled_at / 1000000, snapshot->m_sampled_at % 1000000);
+  }
+
+  // Collector latency, with the buckets of disksize_collector_histogram
+  const char *name = "mysql_disksize_refresh_duration_seconds";
+  append("# HELP %s Time taken by a refresh of the collector.\n"
+         "# TYPE %s histogram\n",
+         name, name);
+  unsigned long long cumulated = 0;
+  for (unsigned int bucket = 0; bucket < DISKSIZE_STATS_BUCKETS; bucket++)
+  {
+    cumulated += disksize_refresh_stats.m_buckets[bucket].load(
+        std::memory_order_relaxed);
+    if (bucket == DISKSIZE_STATS_BUCKETS - 1)
+      append("%s_bucket{le=\"+Inf\"} %llu\n", name, cumulated);
+    else
+      append("%s_bucket{le=\"%g\"} %llu\n", name,
+             disksize_stats_bucket_low(bucket + 1) / 1e9, cumulated);
+  }
+  append("%s_sum %.9f\n%s_count %llu\n", name,
+         disksize_refresh_stats.m_sum.load(std::memory_order_relaxed) / 1e9,
+         name, disksize_refresh_stats.m_count.load(std::memory_order_relaxed));
+}
+
+/* Write to a temporary file renamed over the previous one, false on success */
+static bool write_file(int *error)
+{
+  int fd = open(prometheus_temp_file.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+  {
+    *error = errno;
+    return true;
+  }
+
+  size_t written = 0;
+  while (written < output_length)
+  {
+    ssize_t length =
+        write(fd, output.data() + written, output_length - written);
+    if (length == -1 && errno == EINTR)
+      continue;
+    if (length == -1)
+    {
+      *error = errno;
+      close(fd);
+      unlink(prometheus_temp_file.c_str());
+      return true;
+    }
+    written += length;
+  }
+
+  if (close(fd) == -1 ||
+      rename(prometheus_temp_file.c_str(), prometheus_file.c_str()) == -1)
+  {
+    *error = errno;
+    unlink(prometheus_temp_file.c_str());
+    return true;
+  }
+  return false;
+}
+
+static void export_snapshot()
+{
+  char msgbuf[1024];
+  int error = 0;
+
+  Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+  render(snapshot);
+  disksize_snapshot_release(snapshot);
+
+  if (write_file(&error))
+  {
+    if (!prometheus_failing)
+    {
+      snprintf(msgbuf, sizeof(msgbuf), "Could not write %s: %s",
+               prometheus_file.c_str(), strerror(error));
+      LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+    }
+    prometheus_failing = true;
+  }
+  else
+    prometheus_failing = false;
+}
+
+/*
+  EXPORTER thread
+*/
+
+static void prometheus_main()
+{
+  std::unique_lock<std::mutex> lock(prometheus_mutex);
+  while (!prometheus_stop_requested.load())
+  {
+    lock.unlock();
+    export_snapshot();
+    lock.lock();
+
+    prometheus_wakeup_requested = false;
+    prometheus_cond.wait_for(
+        lock, std::chrono::seconds(disksize_prometheus_interval), [] {
+          return prometheus_stop_requested.load() ||
+                 prometheus_wakeup_requested;
+        });
+  }
+}
+
+/* Nothing is started when disksize.prometheus_dir is empty */
+bool disksize_prometheus_start()
+{
+  if (disksize_prometheus_dir == nullptr ||
+      disksize_prometheus_dir[0] == '\0')
+    return false;
+
+  prometheus_file = std::string(disksize_prometheus_dir) + "/" +
+                    DISKSIZE_PROMETHEUS_FILE_NAME;
+  // node_exporter only reads the files ending in .prom
+  prometheus_temp_file = prometheus_file + ".tmp";
+  prometheus_failing = false;
+  prometheus_stop_requested.store(false);
+  prometheus_wakeup_requested = false;
+  try
+  {
+    prometheus_thread = std::thread(prometheus_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the Prometheus exporter thread");
+    return true;
+  }
+  return false;
+}
+
+void disksize_prometheus_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(prometheus_mutex);
+    prometheus_stop_requested.store(true);
+  }
+  prometheus_cond.notify_all();
+  if (prometheus_thread.joinable())
+    prometheus_thread.join();
+}
+
+void disksize_prometheus_wakeup()
+{
+  {
+    std::lock_guard<std::mutex> lock(prometheus_mutex);
+    prometheus_wakeup_requested = true;
+  }
+  prometheus_cond.notify_all();
+}
@@ -0,0 +1,145 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef PLUGIN_COMPONENT_DISK_SIZE_PUBLISHER_H_
+#define PLUGIN_COMPONENT_DISK_SIZE_PUBLISHER_H_
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mysql/components/services/mysql_mutex.h>
+#include "components/disksize/disksize_stats.h"
+
+/*
+  Lock-free publication of immutable objects built by a background thread.
+
+  The current object is published with an atomic pointer swap. Readers
+  announce themselves in the pinning slot of the current epoch while they
+  load the pointer and take their reference. After a swap the publisher
+  moves the epoch on and waits for the slot of the previous one to drain:
+  only the readers already in their pinning window count there, new ones
+  pin the other slot, so the wait is a few instructions long whatever the
+  reader load. The reference counts of the replaced objects are then exact
+  and the unreferenced ones are freed, after the mutex is released.
+
+  Readers never wait and never lock, they only pin again when a publisher
+  moved the epoch between their choice of slot and their pin. Publishers
+  are serialized by the mutex given to init(), and the time they hold it
+  is recorded in disksize_lock_stats.
+
+  T must have a std::atomic<unsigned int> m_refs member.
+*/
+template <class T>
+class Disksize_publisher {
+ private:
+  std::atomic<T *> m_current{nullptr};
+  std::atomic<unsigned int> m_epoch{0};
+  std::atomic<unsigned int> m_pinning[2] = {{0}, {0}};
+  mysql_mutex_t *m_mutex{nullptr};
+
+  /* Replaced objects not freed yet, protected by m_mutex */
+  std::vector<T *> m_retired;
+
+  /*
+    Must be called with m_mutex held, after the swap. Moves the retired
+    objects nobody references to unreferenced, for the caller to free
+    once it released m_mutex.
+  */
+  void reclaim(std::vector<T *> *unreferenced) {
+    unsigned int previous = m_epoch.fetch_add(1);
+    while (m_pinning[previous & 1].load() != 0) std::this_thread::yield();
+
+    auto it = m_retired.begin();
+    while (it != m_retired.end()) {
+      if ((*it)->m_refs.load(std::memory_order_acquire) == 0) {
+        unreferenced->push_back(*it);
+        it = m_retired.erase(it);
+      } else
+        ++it;
+    }
+  }
+
+ public:
+  void init(mysql_mutex_t *mutex) {
+    m_mutex = mutex;
+    m_retired.clear();
+    m_current.store(nullptr);
+  }
+
+  /* Pin the current object, can return nullptr */
+  T *acquire() {
+    /*
+      The slot must still be the one of the current epoch once pinned:
+      otherwise a publisher may have already waited for it, and the next
+      one waits only for the other slot.
+    */
+    unsigned int epoch = m_epoch.load();
+    m_pinning[epoch & 1].fetch_add(1);
+    for (unsigned int pinned = m_epoch.load(); pinned != epoch;
+         pinned = m_epoch.load()) {
+      m_pinning[epoch & 1].fetch_sub(1);
+      epoch = pinned;
+      m_pinning[epoch & 1].fetch_add(1);
+    }
+    std::atomic<unsigned int> &pinning = m_pinning[epoch & 1];
+    T *current = m_current.load();
+    if (current != nullptr) current->m_refs.fetch_add(1);
+    pinning.fetch_sub(1);
+    return current;
+  }
+
+  void release(T *object) {
+    if (object != nullptr)
+      object->m_refs.fetch_sub(1, std::memory_order_release);
+  }
+
+  /* Replace the current object, takes ownership of object */
+  void publish(T *object) {
+    std::vector<T *> unreferenced;
+    mysql_mutex_lock(m_mutex);
+    unsigned long long locked_at = disksize_now_ns();
+    T *old = m_current.exchange(object);
+    if (old != nullptr) m_retired.push_back(old);
+    reclaim(&unreferenced);
+    disksize_lock_stats.record(disksize_now_ns() - locked_at);
+    mysql_mutex_unlock(m_mutex);
+
+    for (T *unused : unreferenced) delete unused;
+  }
+
+  /* Free everything, nobody can hold a reference anymore */
+  void cleanup() {
+    std::vector<T *> unreferenced;
+    mysql_mutex_lock(m_mutex);
+    T *old = m_current.exchange(nullptr);
+    if (old != nullptr) m_retired.push_back(old);
+    reclaim(&unreferenced);
+    unreferenced.insert(unreferenced.end(), m_retired.begin(),
+                        m_retired.end());
+    m_retired.clear();
+    mysql_mutex_unlock(m_mutex);
+
+    for (T *unused : unreferenced) delete unused;
+  }
+};
+
+#endif
@@ -0,0 +1,116 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+
+/*
+  The lookups only pin the current snapshot: two atomic increments and no
+  lock, whatever the collector is doing. A path is looked up with a binary
+  search per directory level, from the path itself up to "/".
+*/
+
+static void fill_answer(const Disksize_record &row,
+                        unsigned long long *free_bytes,
+                        unsigned long long *total_bytes, bool *is_stale)
+{
+  *free_bytes = row.disksize_dir_size_free.val;
+  *total_bytes = row.disksize_dir_size_total.val;
+  *is_stale = row.disksize_is_stale;
+}
+
+/* The row of the monitored directory dir, already without trailing slash */
+static const Disksize_record *find_dir(const Disksize_snapshot *snapshot,
+                                       std::string_view dir)
+{
+  const std::vector<Disksize_record> &rows = snapshot->m_rows;
+
+  auto it = std::lower_bound(
+      snapshot->m_by_path.begin(), snapshot->m_by_path.end(), dir,
+      [&rows](unsigned int row, std::string_view value) {
+        return disksize_path_key(rows[row].disksize_dir_name.view()) < value;
+      });
+  if (it != snapshot->m_by_path.end() &&
+      disksize_path_key(rows[*it].disksize_dir_name.view()) == dir)
+    return &rows[*it];
+  return nullptr;
+}
+
+DEFINE_BOOL_METHOD(disksize_query_imp::get_by_path,
+                   (const char *path, unsigned long long *free_bytes,
+                    unsigned long long *total_bytes, bool *is_stale))
+{
+  if (path == nullptr)
+    return true;
+
+  Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+  if (snapshot == nullptr)
+    return true;
+
+  // The path itself, else the deepest monitored directory containing it
+  std::string_view key = disksize_path_key(path);
+  const Disksize_record *found = find_dir(snapshot, key);
+  while (found == nullptr && key.size() > 1)
+  {
+    size_t slash = key.rfind('/');
+    if (slash == std::string_view::npos)
+      break;
+    key = disksize_path_key(key.substr(0, slash == 0 ? 1 : slash));
+    found = find_dir(snapshot, key);
+  }
+
+  if (found != nullptr)
+    fill_answer(*found, free_bytes, total_bytes, is_stale);
+  disksize_snapshot_release(snapshot);
+  return found == nullptr;
+}
+
+DEFINE_BOOL_METHOD(disksize_query_imp::get_by_variable,
+                   (const char *variable, unsigned long long *free_bytes,
+                    unsigned long long *total_bytes, bool *is_stale))
+{
+  if (variable == nullptr)
+    return true;
+
+  Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+  if (snapshot == nullptr)
+    return true;
+
+  const std::vector<Disksize_record> &rows = snapshot->m_rows;
+  std::string_view key(variable);
+  bool missing = true;
+
+  auto it = std::lower_bound(
+      snapshot->m_by_related_variable.begin(),
+      snapshot->m_by_related_variable.end(), key,
+      [&rows](unsigned int row, std::string_view value) {
+        return rows[row].disksize_related_variable.view() < value;
+      });
+  // A variable listing several paths answers with the first one
+  if (it != snapshot->m_by_related_variable.end() &&
+      rows[*it].disksize_related_variable.view() == key)
+  {
+    fill_answer(rows[*it], free_bytes, total_bytes, is_stale);
+    missing = false;
+  }
+
+  disksize_snapshot_release(snapshot);
+  return missing;
+}
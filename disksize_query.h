@@ -0,0 +1,85 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef PLUGIN_COMPONENT_DISK_SIZE_QUERY_H_
+#define PLUGIN_COMPONENT_DISK_SIZE_QUERY_H_
+
+#include <mysql/components/service.h>
+
+/**
+  @ingroup group_components_services_inventory
+
+  Free space of the directories monitored by the disksize component, as of
+  its last sample. Nothing is read from disk: the calls pin the snapshot
+  published by the collector and look the value up, without waiting nor
+  locking, so they are cheap enough for a per-query check.
+
+  Usage example:
+
+  @code
+  REQUIRES_SERVICE_PLACEHOLDER(disksize_query);
+
+  unsigned long long free_bytes, total_bytes;
+  bool is_stale;
+  if (!mysql_service_disksize_query->get_by_variable(
+          "tmpdir", &free_bytes, &total_bytes, &is_stale))
+    ...
+  @endcode
+*/
+BEGIN_SERVICE_DEFINITION(disksize_query)
+
+/**
+  Free and total bytes of the filesystem holding a path.
+
+  The path is the DIR_NAME of a monitored directory or a path below one,
+  the deepest monitored directory containing it is used.
+
+  @param path Path to look up, absolute or as given in the server variables
+  @param [out] free_bytes Bytes available to unprivileged users
+  @param [out] total_bytes Size of the filesystem
+  @param [out] is_stale True when the filesystem did not answer the last
+                        probe and the values are the last known ones
+  @retval false Success
+  @retval true No sample yet or the path is not monitored
+*/
+DECLARE_BOOL_METHOD(get_by_path,
+                    (const char *path, unsigned long long *free_bytes,
+                     unsigned long long *total_bytes, bool *is_stale));
+
+/**
+  Free and total bytes of the filesystem of a server variable.
+
+  @param variable RELATED_VARIABLE of disks_size, e.g. "tmpdir" or
+                  "innodb_redo_log_archive_dirs (label)"
+  @param [out] free_bytes Bytes available to unprivileged users
+  @param [out] total_bytes Size of the filesystem
+  @param [out] is_stale See get_by_path()
+  @retval false Success
+  @retval true No sample yet or the variable is not monitored
+*/
+DECLARE_BOOL_METHOD(get_by_variable,
+                    (const char *variable, unsigned long long *free_bytes,
+                     unsigned long long *total_bytes, bool *is_stale));
+
+END_SERVICE_DEFINITION(disksize_query)
+
+#endif /* PLUGIN_COMPONENT_DISK_SIZE_QUERY_H_ */
@@ -0,0 +1,157 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+char *disksize_shm_path = nullptr;
+
+/* The mapping written by the collector, nullptr when disabled */
+static Disksize_shm *shm = nullptr;
+
+/*
+  Sequence lock, writer side. The collector is the only writer: the odd
+  value is published before the rows change, the even one after.
+*/
+static void shm_write_begin()
+{
+  uint64_t sequence = __atomic_load_n(&shm->header.sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&shm->header.sequence, sequence | 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void shm_write_end()
+{
+  uint64_t sequence = __atomic_load_n(&shm->header.sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&shm->header.sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+static void copy_string(char *to, size_t size, std::string_view from)
+{
+  size_t length = std::min(from.size(), size - 1);
+  memcpy(to, from.data(), length);
+  memset(to + length, 0, size - length);
+}
+
+/*
+  Failures are logged and leave the file out, they do not prevent the
+  component from starting.
+*/
+void disksize_shm_open()
+{
+  char msgbuf[1024];
+
+  if (disksize_shm_path == nullptr || disksize_shm_path[0] == '\0')
+    return;
+
+  int fd = open(disksize_shm_path, O_RDWR | O_CREAT | O_CLOEXEC, 0640);
+  if (fd == -1 || ftruncate(fd, sizeof(Disksize_shm)) == -1)
+  {
+    snprintf(msgbuf, sizeof(msgbuf), "Could not create %s: %s",
+             disksize_shm_path, strerror(errno));
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+    if (fd != -1)
+      close(fd);
+    return;
+  }
+  void *mapping = mmap(nullptr, sizeof(Disksize_shm), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    snprintf(msgbuf, sizeof(msgbuf), "Could not map %s: %s", disksize_shm_path,
+             strerror(errno));
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+    return;
+  }
+  shm = (Disksize_shm *)mapping;
+
+  // Readers of a previous run may still map it, keep its sequence going
+  if (shm->header.magic != DISKSIZE_SHM_MAGIC)
+    shm->header.sequence = 0;
+  shm_write_begin();
+  shm->header.magic = DISKSIZE_SHM_MAGIC;
+  shm->header.version = DISKSIZE_SHM_VERSION;
+  shm->header.row_size = sizeof(Disksize_shm_row);
+  shm->header.sampled_at = 0;
+  shm->header.refresh_interval = disksize_refresh_interval;
+  shm->header.row_count = 0;
+  shm->header.writer_pid = getpid();
+  shm_write_end();
+}
+
+/* Only called by the collector */
+void disksize_shm_write(const Disksize_snapshot *snapshot)
+{
+  if (shm == nullptr)
+    return;
+
+  const std::vector<Disksize_record> &rows = snapshot->m_rows;
+  uint32_t row_count = (uint32_t)std::min(rows.size(),
+                                          (size_t)DISKSIZE_SHM_MAX_ROWS);
+
+  shm_write_begin();
+  for (uint32_t i = 0; i < row_count; i++)
+  {
+    const Disksize_record &record = rows[i];
+    Disksize_shm_row &row = shm->rows[i];
+    copy_string(row.dir_name, sizeof(row.dir_name),
+                record.disksize_dir_name.view());
+    copy_string(row.related_variable, sizeof(row.related_variable),
+                record.disksize_related_variable.view());
+    copy_string(row.mount_point, sizeof(row.mount_point),
+                record.disksize_mount_point.view());
+    row.free_bytes = record.disksize_dir_size_free.val;
+    row.total_bytes = record.disksize_dir_size_total.val;
+    row.device_id = record.disksize_device_id.val;
+    row.fill_rate = record.disksize_fill_rate.val;
+    row.seconds_to_full = record.disksize_seconds_to_full.val;
+    row.sampled_at = record.disksize_sampled_at;
+    row.flags = (record.disksize_is_stale ? DISKSIZE_SHM_STALE : 0) |
+                (record.disksize_fill_rate.is_null ? DISKSIZE_SHM_FILL_RATE_NULL
+                                                   : 0) |
+                (record.disksize_seconds_to_full.is_null
+                     ? DISKSIZE_SHM_SECONDS_TO_FULL_NULL
+                     : 0);
+  }
+  shm->header.sampled_at = snapshot->m_sampled_at;
+  shm->header.refresh_interval = disksize_refresh_interval;
+  shm->header.row_count = row_count;
+  shm_write_end();
+}
+
+/* The file is left in place with writer_pid 0, readers see it is stopped */
+void disksize_shm_close()
+{
+  if (shm == nullptr)
+    return;
+
+  shm_write_begin();
+  shm->header.writer_pid = 0;
+  shm_write_end();
+  munmap(shm, sizeof(Disksize_shm));
+  shm = nullptr;
+}
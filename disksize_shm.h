@@ -0,0 +1,168 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef PLUGIN_COMPONENT_DISK_SIZE_SHM_H_
+#define PLUGIN_COMPONENT_DISK_SIZE_SHM_H_
+
+/*
+  Layout of the file disksize.shm_path, and the reader side.
+
+  The collector maps the file and rewrites it after every refresh; host
+  agents map it read-only and copy it without a MySQL connection, a lock or
+  a system call. The writer is protected by a sequence lock: the sequence
+  is odd while the rows are being written, a reader retries when it was odd
+  or changed during its copy.
+
+  The layout is fixed: native byte order, every field at the offset it has
+  in these structures, strings NUL terminated and truncated to their
+  buffer. A change to it bumps DISKSIZE_SHM_VERSION.
+
+  This header does not depend on the server, an agent only needs it:
+
+    struct Disksize_shm *shm = disksize_shm_map("/dev/shm/mysql-disksize");
+    struct Disksize_shm copy;
+    if (shm != NULL && disksize_shm_read(shm, &copy) == 0)
+      for (uint32_t i = 0; i < copy.header.row_count; i++)
+        ... copy.rows[i].free_bytes ...
+    disksize_shm_unmap(shm);
+*/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* "disksize" */
+#define DISKSIZE_SHM_MAGIC 0x657a69736b736964ULL
+#define DISKSIZE_SHM_VERSION 1
+#define DISKSIZE_SHM_MAX_ROWS 100
+#define DISKSIZE_SHM_NAME_LENGTH 256
+#define DISKSIZE_SHM_VARIABLE_LENGTH 128
+
+/* Bits of Disksize_shm_row.flags */
+#define DISKSIZE_SHM_STALE 1
+#define DISKSIZE_SHM_FILL_RATE_NULL 2
+#define DISKSIZE_SHM_SECONDS_TO_FULL_NULL 4
+
+/* Same columns as performance_schema.disks_size */
+struct Disksize_shm_row {
+  char dir_name[DISKSIZE_SHM_NAME_LENGTH];
+  char related_variable[DISKSIZE_SHM_VARIABLE_LENGTH];
+  char mount_point[DISKSIZE_SHM_NAME_LENGTH];
+  uint64_t free_bytes;
+  uint64_t total_bytes;
+  uint64_t device_id;
+  int64_t fill_rate;
+  uint64_t seconds_to_full;
+  /* Microseconds since the epoch */
+  uint64_t sampled_at;
+  uint64_t flags;
+};
+
+struct Disksize_shm_header {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t row_size;
+  /* Odd while the writer updates the file */
+  uint64_t sequence;
+  /* Time of the last refresh, in microseconds since the epoch */
+  uint64_t sampled_at;
+  /* disksize.refresh_interval, to tell a stopped writer */
+  uint32_t refresh_interval;
+  uint32_t row_count;
+  /* Process id of mysqld, 0 once the component is uninstalled */
+  uint64_t writer_pid;
+};
+
+struct Disksize_shm {
+  struct Disksize_shm_header header;
+  struct Disksize_shm_row rows[DISKSIZE_SHM_MAX_ROWS];
+};
+
+/* Map the file read-only, NULL when it is missing or not a disksize file */
+static inline struct Disksize_shm *disksize_shm_map(const char *path)
+{
+  struct stat file_stat;
+  void *shm;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &file_stat) == -1 ||
+      (size_t)file_stat.st_size < sizeof(struct Disksize_shm))
+  {
+    close(fd);
+    return NULL;
+  }
+  shm = mmap(NULL, sizeof(struct Disksize_shm), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+    return NULL;
+  if (((struct Disksize_shm *)shm)->header.magic != DISKSIZE_SHM_MAGIC)
+  {
+    munmap(shm, sizeof(struct Disksize_shm));
+    return NULL;
+  }
+  return (struct Disksize_shm *)shm;
+}
+
+static inline void disksize_shm_unmap(struct Disksize_shm *shm)
+{
+  if (shm != NULL)
+    munmap(shm, sizeof(struct Disksize_shm));
+}
+
+/*
+  Copy a consistent version of the file.
+  Returns 0 on success, 1 when the writer kept it busy, 2 when the layout
+  is not the one of this header.
+*/
+static inline int disksize_shm_read(const struct Disksize_shm *shm,
+                                    struct Disksize_shm *copy)
+{
+  for (int attempt = 0; attempt < 1000; attempt++)
+  {
+    uint64_t before = __atomic_load_n(&shm->header.sequence, __ATOMIC_ACQUIRE);
+    if (before & 1)
+      continue;
+
+    memcpy(&copy->header, &shm->header, sizeof(copy->header));
+    uint32_t rows = copy->header.row_count;
+    if (copy->header.version != DISKSIZE_SHM_VERSION ||
+        copy->header.row_size != sizeof(struct Disksize_shm_row))
+      return 2;
+    if (rows > DISKSIZE_SHM_MAX_ROWS)
+      rows = DISKSIZE_SHM_MAX_ROWS;
+    memcpy(copy->rows, shm->rows, rows * sizeof(struct Disksize_shm_row));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shm->header.sequence, __ATOMIC_RELAXED) == before)
+    {
+      copy->header.row_count = rows;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+#endif /* PLUGIN_COMPONENT_DISK_SIZE_SHM_H_ */
@@ -0,0 +1,77 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+/*
+  disksize_shm_dump: print the file written by the disksize component when
+  disksize.shm_path is set, without connecting to the server.
+
+  Usage: disksize_shm_dump <path>
+*/
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "components/disksize/disksize_shm.h"
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    fprintf(stderr, "Usage: %s <disksize.shm_path>\n", argv[0]);
+    return 2;
+  }
+
+  struct Disksize_shm *shm = disksize_shm_map(argv[1]);
+  if (shm == nullptr)
+  {
+    fprintf(stderr, "%s is not a disksize file\n", argv[1]);
+    return 1;
+  }
+
+  static struct Disksize_shm copy;
+  int error = disksize_shm_read(shm, &copy);
+  disksize_shm_unmap(shm);
+  if (error == 2)
+  {
+    fprintf(stderr, "%s has an unknown layout\n", argv[1]);
+    return 1;
+  }
+  if (error != 0)
+  {
+    fprintf(stderr, "%s is being written, try again\n", argv[1]);
+    return 1;
+  }
+
+  printf("# sampled_at=%" PRIu64 " refresh_interval=%" PRIu32
+         " writer_pid=%" PRIu64 "\n",
+         copy.header.sampled_at, copy.header.refresh_interval,
+         copy.header.writer_pid);
+  printf("DIR_NAME\tRELATED_VARIABLE\tMOUNT_POINT\tFREE\tTOTAL\tDEVICE_ID"
+         "\tSAMPLED_AT\tIS_STALE\n");
+  for (uint32_t i = 0; i < copy.header.row_count; i++)
+  {
+    const struct Disksize_shm_row &row = copy.rows[i];
+    printf("%s\t%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+           "\t%s\n",
+           row.dir_name, row.related_variable, row.mount_point,
+           row.free_bytes, row.total_bytes, row.device_id, row.sampled_at,
+           (row.flags & DISKSIZE_SHM_STALE) ? "YES" : "NO");
+  }
+  return 0;
+}
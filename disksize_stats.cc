@@ -0,0 +1,481 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <map>
+
+/*
+  DATA
+*/
+
+Disksize_timer_stats disksize_refresh_stats;
+Disksize_timer_stats disksize_lock_stats;
+std::atomic<unsigned long long> disksize_table_opens{0};
+std::atomic<unsigned long long> disksize_rows_served{0};
+
+/* Values of enum('GLOBAL','PATH','FILESYSTEM') */
+#define DISKSIZE_STATS_GLOBAL 1ULL
+#define DISKSIZE_STATS_PATH 2ULL
+#define DISKSIZE_STATS_FILESYSTEM 3ULL
+
+/* Rows of type GLOBAL, always listed first */
+#define DISKSIZE_STATS_GLOBAL_COUNT 4
+
+/* Append only, entries are published with a release store of the count */
+static std::atomic<Disksize_probe_stats *> path_stats[DISKSIZE_MAX_ROWS];
+static std::atomic<unsigned int> path_stats_count{0};
+static std::atomic<Disksize_probe_stats *> filesystem_stats[DISKSIZE_MAX_ROWS];
+static std::atomic<unsigned int> filesystem_stats_count{0};
+
+/* Lookups of the collector, the only writer */
+static std::map<std::string, Disksize_probe_stats *> path_stats_by_name;
+static std::map<unsigned long long, Disksize_probe_stats *>
+    filesystem_stats_by_device;
+
+static Disksize_probe_stats *add_probe_stats(
+    std::atomic<Disksize_probe_stats *> *entries,
+    std::atomic<unsigned int> *count, const std::string &name)
+{
+  unsigned int n = count->load(std::memory_order_relaxed);
+  if (n == DISKSIZE_MAX_ROWS)
+    return nullptr;
+
+  Disksize_probe_stats *stats = new Disksize_probe_stats;
+  stats->m_name = name;
+  entries[n].store(stats, std::memory_order_relaxed);
+  count->store(n + 1, std::memory_order_release);
+  return stats;
+}
+
+Disksize_probe_stats *disksize_path_stats(const std::string &path)
+{
+  auto found = path_stats_by_name.find(path);
+  if (found != path_stats_by_name.end())
+    return found->second;
+
+  Disksize_probe_stats *stats =
+      add_probe_stats(path_stats, &path_stats_count, path);
+  if (stats != nullptr)
+    path_stats_by_name[path] = stats;
+  return stats;
+}
+
+Disksize_probe_stats *disksize_filesystem_stats(unsigned long long device_id,
+                                                const std::string &name)
+{
+  auto found = filesystem_stats_by_device.find(device_id);
+  if (found != filesystem_stats_by_device.end())
+    return found->second;
+
+  Disksize_probe_stats *stats =
+      add_probe_stats(filesystem_stats, &filesystem_stats_count, name);
+  if (stats != nullptr)
+    filesystem_stats_by_device[device_id] = stats;
+  return stats;
+}
+
+/* Called once the collector is stopped and the tables removed */
+void cleanup_disksize_stats()
+{
+  unsigned int count = path_stats_count.exchange(0);
+  for (unsigned int i = 0; i < count; i++)
+    delete path_stats[i].exchange(nullptr);
+  count = filesystem_stats_count.exchange(0);
+  for (unsigned int i = 0; i < count; i++)
+    delete filesystem_stats[i].exchange(nullptr);
+  path_stats_by_name.clear();
+  filesystem_stats_by_device.clear();
+}
+
+/*
+  Describe object number index: the GLOBAL rows, then the paths, then the
+  filesystems. False past the objects visible to the handle.
+*/
+static bool stats_object(const Disksize_stats_Table_Handle *h,
+                         unsigned int index, Disksize_stats_row *row)
+{
+  if (index >= h->m_object_count)
+    return false;
+
+  *row = Disksize_stats_row();
+  if (index < DISKSIZE_STATS_GLOBAL_COUNT)
+  {
+    row->m_type = DISKSIZE_STATS_GLOBAL;
+    switch (index)
+    {
+    case 0:
+      row->m_name = "refresh";
+      row->m_timer = &disksize_refresh_stats;
+      break;
+    case 1:
+      row->m_name = "LOCK_disksize_data";
+      row->m_timer = &disksize_lock_stats;
+      break;
+    case 2:
+      row->m_name = "table_open";
+      row->m_counter = &disksize_table_opens;
+      break;
+    default:
+      row->m_name = "rows_served";
+      row->m_counter = &disksize_rows_served;
+      break;
+    }
+    return true;
+  }
+
+  index -= DISKSIZE_STATS_GLOBAL_COUNT;
+  if (index < h->m_path_count)
+  {
+    row->m_type = DISKSIZE_STATS_PATH;
+    row->m_probe = path_stats[index].load(std::memory_order_relaxed);
+  }
+  else
+  {
+    row->m_type = DISKSIZE_STATS_FILESYSTEM;
+    row->m_probe = filesystem_stats[index - h->m_path_count].load(
+        std::memory_order_relaxed);
+  }
+  row->m_name = row->m_probe->m_name;
+  row->m_timer = &row->m_probe->m_latency;
+  return true;
+}
+
+static Disksize_stats_Table_Handle *stats_open(PSI_pos **pos)
+{
+  MYSQL_THD thd;
+  Disksize_stats_Table_Handle *temp = new Disksize_stats_Table_Handle();
+
+  mysql_service_mysql_current_thread_reader->get(&thd);
+  if (!have_required_privilege(thd))
+  {
+    mysql_error_service_printf(
+        ER_SPECIFIC_ACCESS_DENIED_ERROR, 0,
+        PRIVILEGE_NAME);
+  }
+  else
+  {
+    // Entries added after this point are not visible to this handle
+    temp->m_path_count = path_stats_count.load(std::memory_order_acquire);
+    temp->m_object_count =
+        DISKSIZE_STATS_GLOBAL_COUNT + temp->m_path_count +
+        filesystem_stats_count.load(std::memory_order_acquire);
+  }
+
+  *pos = (PSI_pos *)(&temp->m_pos);
+  return temp;
+}
+
+static void set_timer(PSI_field *field, const Disksize_timer_stats *timer,
+                      unsigned long long ns)
+{
+  pfs_bigint->set_unsigned(field, {ns * DISKSIZE_PICO_PER_NANO,
+                                   timer == nullptr});
+}
+
+/*
+  DATA access (disksize_collector_stats)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_stats_st_share;
+
+PSI_table_handle *disksize_stats_open_table(PSI_pos **pos)
+{
+  return (PSI_table_handle *)stats_open(pos);
+}
+
+void disksize_stats_close_table(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *temp = (Disksize_stats_Table_Handle *)handle;
+  delete temp;
+}
+
+int disksize_stats_rnd_next(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  h->m_pos.set_at(&h->m_next_pos);
+
+  if (stats_object(h, h->m_pos.get_index(), &h->current_row))
+  {
+    h->m_next_pos.set_after(&h->m_pos);
+    return 0;
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int disksize_stats_rnd_init(PSI_table_handle *, bool) { return 0; }
+
+int disksize_stats_rnd_pos(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  stats_object(h, h->m_pos.get_index(), &h->current_row);
+  return 0;
+}
+
+void disksize_stats_reset_position(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  h->m_pos.reset();
+  h->m_next_pos.reset();
+  return;
+}
+
+int disksize_stats_read_column_value(PSI_table_handle *handle,
+                                     PSI_field *field, unsigned int index)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  const Disksize_stats_row *row = &h->current_row;
+  const Disksize_timer_stats *timer = row->m_timer;
+  unsigned long long count = 0;
+
+  if (timer != nullptr)
+    count = timer->m_count.load(std::memory_order_relaxed);
+  else if (row->m_counter != nullptr)
+    count = row->m_counter->load(std::memory_order_relaxed);
+
+  switch (index)
+  {
+  case 0: /* OBJECT_TYPE */
+    pfs_enum->set(field, {row->m_type, false});
+    break;
+  case 1: /* OBJECT_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row->m_name.data(),
+                                        (unsigned int)row->m_name.length());
+    break;
+  case 2: /* COUNT_STAR */
+    pfs_bigint->set_unsigned(field, {count, false});
+    break;
+  case 3: /* COUNT_ERROR */
+    pfs_bigint->set_unsigned(
+        field, {row->m_probe != nullptr
+                    ? row->m_probe->m_errors.load(std::memory_order_relaxed)
+                    : 0,
+                row->m_probe == nullptr});
+    break;
+  case 4: /* COUNT_TIMEOUT */
+    pfs_bigint->set_unsigned(
+        field, {row->m_probe != nullptr
+                    ? row->m_probe->m_timeouts.load(std::memory_order_relaxed)
+                    : 0,
+                row->m_probe == nullptr});
+    break;
+  case 5: /* SUM_TIMER_WAIT */
+    set_timer(field, timer,
+              timer ? timer->m_sum.load(std::memory_order_relaxed) : 0);
+    break;
+  case 6: /* AVG_TIMER_WAIT */
+    set_timer(field, timer,
+              timer && count != 0
+                  ? timer->m_sum.load(std::memory_order_relaxed) / count
+                  : 0);
+    break;
+  case 7: /* MAX_TIMER_WAIT */
+    set_timer(field, timer,
+              timer ? timer->m_max.load(std::memory_order_relaxed) : 0);
+    break;
+  case 8: /* LAST_TIMER_WAIT */
+    set_timer(field, timer,
+              timer ? timer->m_last.load(std::memory_order_relaxed) : 0);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+  return 0;
+}
+
+unsigned long long disksize_stats_get_row_count(void)
+{
+  return DISKSIZE_STATS_GLOBAL_COUNT +
+         path_stats_count.load(std::memory_order_relaxed) +
+         filesystem_stats_count.load(std::memory_order_relaxed);
+}
+
+void init_disksize_stats_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disksize_collector_stats";
+  share->m_table_name_length = 24;
+  share->m_table_definition =
+      "OBJECT_TYPE enum('GLOBAL','PATH','FILESYSTEM') not null, "
+      "OBJECT_NAME varchar(512) not null, COUNT_STAR bigint unsigned not null, "
+      "COUNT_ERROR bigint unsigned, COUNT_TIMEOUT bigint unsigned, "
+      "SUM_TIMER_WAIT bigint unsigned, AVG_TIMER_WAIT bigint unsigned, "
+      "MAX_TIMER_WAIT bigint unsigned, LAST_TIMER_WAIT bigint unsigned";
+  share->m_ref_length = sizeof(Disksize_POS);
+  share->m_acl = READONLY;
+  share->get_row_count = disksize_stats_get_row_count;
+  share->delete_all_rows = nullptr; /* READONLY TABLE */
+
+  share->m_proxy_engine_table = {
+      disksize_stats_rnd_next, disksize_stats_rnd_init, disksize_stats_rnd_pos,
+      nullptr, nullptr, nullptr,
+      disksize_stats_read_column_value, disksize_stats_reset_position,
+      /* READONLY TABLE */
+      nullptr, /* write_column_value */
+      nullptr, /* write_row_values */
+      nullptr, /* update_column_value */
+      nullptr, /* update_row_values */
+      nullptr, /* delete_row_values */
+      disksize_stats_open_table, disksize_stats_close_table};
+}
+
+/*
+  DATA access (disksize_collector_histogram)
+
+  One row per bucket of every timed object, the position is
+  object * DISKSIZE_STATS_BUCKETS + bucket.
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_histogram_st_share;
+
+/* Row at position, or the next one when that object has no timer */
+static bool histogram_row(Disksize_stats_Table_Handle *h, unsigned int *pos)
+{
+  while (stats_object(h, *pos / DISKSIZE_STATS_BUCKETS, &h->current_row))
+  {
+    if (h->current_row.m_timer != nullptr)
+    {
+      h->current_row.m_bucket = *pos % DISKSIZE_STATS_BUCKETS;
+      return true;
+    }
+    *pos = (*pos / DISKSIZE_STATS_BUCKETS + 1) * DISKSIZE_STATS_BUCKETS;
+  }
+  return false;
+}
+
+PSI_table_handle *disksize_histogram_open_table(PSI_pos **pos)
+{
+  return (PSI_table_handle *)stats_open(pos);
+}
+
+void disksize_histogram_close_table(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *temp = (Disksize_stats_Table_Handle *)handle;
+  delete temp;
+}
+
+int disksize_histogram_rnd_next(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  unsigned int pos = h->m_next_pos.get_index();
+
+  if (histogram_row(h, &pos))
+  {
+    h->m_pos.set_at(pos);
+    h->m_next_pos.set_after(&h->m_pos);
+    return 0;
+  }
+
+  return PFS_HA_ERR_END_OF_FILE;
+}
+
+int disksize_histogram_rnd_init(PSI_table_handle *, bool) { return 0; }
+
+int disksize_histogram_rnd_pos(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  unsigned int pos = h->m_pos.get_index();
+  histogram_row(h, &pos);
+  return 0;
+}
+
+void disksize_histogram_reset_position(PSI_table_handle *handle)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  h->m_pos.reset();
+  h->m_next_pos.reset();
+  return;
+}
+
+int disksize_histogram_read_column_value(PSI_table_handle *handle,
+                                         PSI_field *field, unsigned int index)
+{
+  Disksize_stats_Table_Handle *h = (Disksize_stats_Table_Handle *)handle;
+  const Disksize_stats_row *row = &h->current_row;
+  unsigned int bucket = row->m_bucket;
+
+  if (row->m_timer == nullptr)
+    return 0;
+
+  switch (index)
+  {
+  case 0: /* OBJECT_TYPE */
+    pfs_enum->set(field, {row->m_type, false});
+    break;
+  case 1: /* OBJECT_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row->m_name.data(),
+                                        (unsigned int)row->m_name.length());
+    break;
+  case 2: /* BUCKET_NUMBER */
+    pfs_bigint->set_unsigned(field, {bucket, false});
+    break;
+  case 3: /* BUCKET_TIMER_LOW */
+    set_timer(field, row->m_timer, disksize_stats_bucket_low(bucket));
+    break;
+  case 4: /* BUCKET_TIMER_HIGH, NULL for the last bucket */
+    pfs_bigint->set_unsigned(
+        field, {disksize_stats_bucket_low(bucket + 1) * DISKSIZE_PICO_PER_NANO,
+                bucket == DISKSIZE_STATS_BUCKETS - 1});
+    break;
+  case 5: /* COUNT_BUCKET */
+    pfs_bigint->set_unsigned(
+        field,
+        {row->m_timer->m_buckets[bucket].load(std::memory_order_relaxed),
+         false});
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+  return 0;
+}
+
+unsigned long long disksize_histogram_get_row_count(void)
+{
+  return disksize_stats_get_row_count() * DISKSIZE_STATS_BUCKETS;
+}
+
+void init_disksize_histogram_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disksize_collector_histogram";
+  share->m_table_name_length = 28;
+  share->m_table_definition =
+      "OBJECT_TYPE enum('GLOBAL','PATH','FILESYSTEM') not null, "
+      "OBJECT_NAME varchar(512) not null, "
+      "BUCKET_NUMBER bigint unsigned not null, "
+      "BUCKET_TIMER_LOW bigint unsigned not null, "
+      "BUCKET_TIMER_HIGH bigint unsigned, COUNT_BUCKET bigint unsigned not null";
+  share->m_ref_length = sizeof(Disksize_POS);
+  share->m_acl = READONLY;
+  share->get_row_count = disksize_histogram_get_row_count;
+  share->delete_all_rows = nullptr; /* READONLY TABLE */
+
+  share->m_proxy_engine_table = {
+      disksize_histogram_rnd_next, disksize_histogram_rnd_init,
+      disksize_histogram_rnd_pos,
+      nullptr, nullptr, nullptr,
+      disksize_histogram_read_column_value, disksize_histogram_reset_position,
+      /* READONLY TABLE */
+      nullptr, /* write_column_value */
+      nullptr, /* write_row_values */
+      nullptr, /* update_column_value */
+      nullptr, /* update_row_values */
+      nullptr, /* delete_row_values */
+      disksize_histogram_open_table, disksize_histogram_close_table};
+}
@@ -0,0 +1,105 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#ifndef PLUGIN_COMPONENT_DISK_SIZE_STATS_H_
+#define PLUGIN_COMPONENT_DISK_SIZE_STATS_H_
+
+#include <atomic>
+#include <chrono>
+
+/*
+  Self instrumentation of the component.
+
+  Counters are relaxed atomics: they are only read by the
+  disksize_collector_stats tables, which do not need a consistent view of
+  them, so recording costs a few uncontended stores.
+*/
+
+/*
+  Latency histogram buckets: bucket 0 is below 1 microsecond, bucket i
+  covers [2^(i-1), 2^i) microseconds and the last one has no upper bound.
+*/
+#define DISKSIZE_STATS_BUCKETS 26
+
+/* Timers are in picoseconds, as everywhere in performance_schema */
+#define DISKSIZE_PICO_PER_NANO 1000ULL
+
+inline unsigned long long disksize_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/* Lower bound of a bucket, in nanoseconds */
+inline unsigned long long disksize_stats_bucket_low(unsigned int bucket) {
+  return bucket == 0 ? 0 : 1000ULL << (bucket - 1);
+}
+
+/* Timings of one operation, recorded by one thread at a time */
+struct Disksize_timer_stats {
+  std::atomic<unsigned long long> m_count{0};
+  std::atomic<unsigned long long> m_sum{0};
+  std::atomic<unsigned long long> m_max{0};
+  std::atomic<unsigned long long> m_last{0};
+  std::atomic<unsigned long long> m_buckets[DISKSIZE_STATS_BUCKETS]{};
+
+  void record(unsigned long long ns) {
+    unsigned int bucket = 0;
+    for (unsigned long long us = ns / 1000;
+         us != 0 && bucket < DISKSIZE_STATS_BUCKETS - 1; us >>= 1)
+      bucket++;
+
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(ns, std::memory_order_relaxed);
+    m_last.store(ns, std::memory_order_relaxed);
+    if (ns > m_max.load(std::memory_order_relaxed))
+      m_max.store(ns, std::memory_order_relaxed);
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /*
+    Upper bound of the bucket holding the given fraction of the samples,
+    capped by the maximum: within a factor 2 of the exact percentile.
+  */
+  unsigned long long percentile(double fraction) const {
+    unsigned long long count = m_count.load(std::memory_order_relaxed);
+    unsigned long long max = m_max.load(std::memory_order_relaxed);
+    unsigned long long wanted = (unsigned long long)(count * fraction);
+    unsigned long long seen = 0;
+
+    if (wanted == 0) wanted = 1;
+    for (unsigned int bucket = 0; bucket < DISKSIZE_STATS_BUCKETS - 1;
+         bucket++) {
+      seen += m_buckets[bucket].load(std::memory_order_relaxed);
+      if (seen >= wanted) {
+        unsigned long long high = disksize_stats_bucket_low(bucket + 1);
+        return high < max ? high : max;
+      }
+    }
+    return max;
+  }
+};
+
+/* Time spent holding LOCK_disksize_data */
+extern Disksize_timer_stats disksize_lock_stats;
+
+#endif
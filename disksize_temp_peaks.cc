@@ -0,0 +1,495 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "components/disksize/disksize.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+
+unsigned int disksize_temp_sample_interval =
+    DISKSIZE_DEFAULT_TEMP_SAMPLE_INTERVAL;
+unsigned int disksize_temp_peak_window = DISKSIZE_DEFAULT_TEMP_PEAK_WINDOW;
+
+/* The variables of variables_to_parse holding temporary files */
+static const char *temp_variables[] = {"tmpdir", "innodb_temp_tablespaces_dir",
+                                       "innodb_tmpdir", "replica_load_tmpdir"};
+
+static bool is_temp_variable(std::string_view variable)
+{
+  for (const char *name : temp_variables)
+    if (variable == name)
+      return true;
+  return false;
+}
+
+/*
+  RING
+
+  Lock-free ring with one producer (the sampler thread) and one consumer
+  (the collector thread). Each side only writes its own index.
+*/
+struct Temp_sample {
+  unsigned long long device_id;
+  /* Microseconds since the epoch */
+  unsigned long long at;
+  unsigned long long size;
+  unsigned long long used;
+};
+
+template <class T, size_t N>
+class Temp_ring {
+  static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+
+ private:
+  T m_items[N];
+  /* Next item written, only stored by the producer */
+  alignas(64) std::atomic<size_t> m_head{0};
+  /* Next item read, only stored by the consumer */
+  alignas(64) std::atomic<size_t> m_tail{0};
+
+ public:
+  /* False when the ring is full */
+  bool push(const T &item) {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == N) return false;
+    m_items[head & (N - 1)] = item;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <class F>
+  void drain(F f) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) f(m_items[tail & (N - 1)]);
+    m_tail.store(tail, std::memory_order_release);
+  }
+
+  /* Only when neither side is running */
+  void reset() {
+    m_head.store(0);
+    m_tail.store(0);
+  }
+};
+
+static Temp_ring<Temp_sample, DISKSIZE_TEMP_RING_SIZE> temp_ring;
+
+/*
+  SAMPLER thread
+
+  One statvfs() per filesystem holding a temporary directory, run by the
+  probe pool so that a hung mount never blocks the sampler: the filesystem
+  is not sampled again until its probe returns. The filesystems are taken
+  from the disks_size snapshot, at most once a second.
+*/
+class Temp_probe : public Disksize_probe {
+ public:
+  std::string m_path;
+  /* Microseconds since the epoch, when the probe was queued */
+  unsigned long long m_at{0};
+  bool m_ok{false};
+  unsigned long long m_size{0};
+  unsigned long long m_used{0};
+
+  void run() override {
+    struct statvfs buf;
+    if (statvfs(m_path.c_str(), &buf) == -1)
+      return;
+
+    // Same computation as the collector, so the values can be compared
+    m_size = (unsigned long long)buf.f_blocks * buf.f_bsize;
+    unsigned long long free = (unsigned long long)buf.f_bavail * buf.f_bsize;
+    m_used = (m_size > free) ? m_size - free : 0;
+    m_ok = true;
+  }
+};
+
+struct Temp_target {
+  unsigned long long device_id;
+  std::string path;
+  /* Highest sample not pushed yet because the ring was full */
+  Temp_sample pending;
+  bool has_pending{false};
+  /* Probe which did not return in time */
+  std::shared_ptr<Temp_probe> stuck;
+};
+
+static std::vector<Temp_target> temp_targets;
+static unsigned long long temp_targets_sampled_at = 0;
+
+static std::thread temp_sampler_thread;
+static std::mutex temp_sampler_mutex;
+static std::condition_variable temp_sampler_cond;
+static std::atomic<bool> temp_sampler_stop_requested{false};
+static bool temp_sampler_wakeup_requested = false;
+
+static void refresh_temp_targets()
+{
+  Disksize_snapshot *snapshot = disksize_snapshot_acquire();
+  if (snapshot == nullptr || snapshot->m_sampled_at == temp_targets_sampled_at)
+  {
+    disksize_snapshot_release(snapshot);
+    return;
+  }
+  temp_targets_sampled_at = snapshot->m_sampled_at;
+
+  std::vector<Temp_target> targets;
+  for (const Disksize_record &row : snapshot->m_rows)
+  {
+    if (row.disksize_is_stale ||
+        !is_temp_variable(row.disksize_related_variable.view()))
+      continue;
+
+    unsigned long long device_id = row.disksize_device_id.val;
+    bool known = false;
+    for (const Temp_target &target : targets)
+      known = known || (target.device_id == device_id);
+    if (known)
+      continue;
+
+    Temp_target &target = targets.emplace_back();
+    target.device_id = device_id;
+    target.path = row.disksize_dir_name.view();
+    // A filesystem still sampled keeps its pending peak and stuck probe
+    for (const Temp_target &previous : temp_targets)
+      if (previous.device_id == device_id)
+      {
+        target.pending = previous.pending;
+        target.has_pending = previous.has_pending;
+        target.stuck = previous.stuck;
+      }
+  }
+  disksize_snapshot_release(snapshot);
+  temp_targets.swap(targets);
+}
+
+static void record_temp_sample(Temp_target *target, const Temp_probe &probe)
+{
+  if (!probe.m_ok)
+    return;
+
+  /*
+    When the ring is full the highest sample waits for the next one, so
+    a slow consumer costs resolution but never a peak.
+  */
+  if (!target->has_pending || probe.m_used > target->pending.used)
+  {
+    target->pending = {target->device_id, probe.m_at, probe.m_size,
+                       probe.m_used};
+    target->has_pending = true;
+  }
+  if (temp_ring.push(target->pending))
+    target->has_pending = false;
+}
+
+static void sample_temp_targets()
+{
+  unsigned long long now =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  std::vector<std::shared_ptr<Disksize_probe>> probes;
+  std::vector<std::pair<Temp_target *, std::shared_ptr<Temp_probe>>> running;
+  for (Temp_target &target : temp_targets)
+  {
+    if (target.stuck)
+    {
+      if (!target.stuck->is_done())
+        continue;
+      // Late, but still a sample of that filesystem
+      record_temp_sample(&target, *target.stuck);
+      target.stuck.reset();
+    }
+    auto probe = std::make_shared<Temp_probe>();
+    probe->m_path = target.path;
+    probe->m_at = now;
+    running.emplace_back(&target, probe);
+    probes.push_back(probe);
+  }
+  disksize_probe_run(probes, disksize_probe_timeout);
+
+  for (auto &entry : running)
+  {
+    if (entry.second->is_done())
+      record_temp_sample(entry.first, *entry.second);
+    // Not started: the pool was busy, it is simply tried again next time
+    else if (entry.second->is_started())
+      entry.first->stuck = entry.second;
+  }
+}
+
+static void temp_sampler_main()
+{
+  std::unique_lock<std::mutex> lock(temp_sampler_mutex);
+  auto next_sample = std::chrono::steady_clock::now();
+  auto next_targets = next_sample;
+
+  while (!temp_sampler_stop_requested.load())
+  {
+    unsigned int interval = disksize_temp_sample_interval;
+    // The value set at startup is not raised by the update function
+    if (interval > 0 && interval < DISKSIZE_MIN_TEMP_SAMPLE_INTERVAL)
+      interval = DISKSIZE_MIN_TEMP_SAMPLE_INTERVAL;
+    if (interval > 0)
+    {
+      lock.unlock();
+      auto now = std::chrono::steady_clock::now();
+      if (now >= next_targets)
+      {
+        refresh_temp_targets();
+        next_targets = now + std::chrono::seconds(1);
+      }
+      sample_temp_targets();
+      lock.lock();
+
+      // Fixed rate, without catching up when a statvfs() was slow
+      next_sample += std::chrono::milliseconds(interval);
+      if (next_sample < now)
+        next_sample = now + std::chrono::milliseconds(interval);
+    }
+
+    temp_sampler_wakeup_requested = false;
+    auto predicate = [] {
+      return temp_sampler_stop_requested.load() ||
+             temp_sampler_wakeup_requested;
+    };
+    if (interval == 0)
+      temp_sampler_cond.wait(lock, predicate);
+    else
+      temp_sampler_cond.wait_until(lock, next_sample, predicate);
+
+    if (temp_sampler_wakeup_requested)
+      next_sample = std::chrono::steady_clock::now();
+  }
+}
+
+bool disksize_temp_sampler_start()
+{
+  temp_sampler_stop_requested.store(false);
+  temp_sampler_wakeup_requested = false;
+  try
+  {
+    temp_sampler_thread = std::thread(temp_sampler_main);
+  }
+  catch (const std::system_error &)
+  {
+    LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG,
+                    "Could not start the temporary space sampler thread");
+    return true;
+  }
+  return false;
+}
+
+/*
+  The thread never blocks in statvfs(), it is joined after its current
+  sample. A probe stuck on a hung mount is left to the probe pool.
+*/
+void disksize_temp_sampler_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(temp_sampler_mutex);
+    temp_sampler_stop_requested.store(true);
+  }
+  temp_sampler_cond.notify_all();
+  if (temp_sampler_thread.joinable())
+    temp_sampler_thread.join();
+  temp_targets = std::vector<Temp_target>();
+  temp_targets_sampled_at = 0;
+}
+
+void disksize_temp_sampler_wakeup()
+{
+  {
+    std::lock_guard<std::mutex> lock(temp_sampler_mutex);
+    temp_sampler_wakeup_requested = true;
+  }
+  temp_sampler_cond.notify_all();
+}
+
+/*
+  PEAKS, only used by the collector thread
+*/
+struct Temp_window {
+  unsigned long long start;
+  unsigned long long count{0};
+  unsigned long long size{0};
+  unsigned long long min_used{0};
+  unsigned long long peak_used{0};
+  unsigned long long peak_at{0};
+};
+
+/* Last DISKSIZE_TEMP_PEAK_WINDOWS windows of each filesystem */
+static std::map<unsigned long long, std::deque<Temp_window>> temp_windows;
+
+static Disksize_publisher<Disksize_temp_peak_snapshot> temp_peak_publisher;
+
+void init_disksize_temp_peaks()
+{
+  temp_peak_publisher.init(&LOCK_disksize_data);
+}
+
+/* Called once the sampler and the collector are stopped */
+void cleanup_disksize_temp_peaks()
+{
+  temp_peak_publisher.cleanup();
+  temp_windows.clear();
+  temp_ring.reset();
+}
+
+static void add_temp_sample(const Temp_sample &sample)
+{
+  unsigned long long length = disksize_temp_peak_window * 1000000ULL;
+  unsigned long long start = sample.at - sample.at % length;
+  std::deque<Temp_window> &windows = temp_windows[sample.device_id];
+
+  // A late sample (merged while the ring was full) goes to the last window
+  if (windows.empty() || start > windows.back().start)
+  {
+    windows.push_back({start});
+    if (windows.size() > DISKSIZE_TEMP_PEAK_WINDOWS)
+      windows.pop_front();
+  }
+
+  Temp_window &window = windows.back();
+  if (window.count == 0 || sample.used < window.min_used)
+    window.min_used = sample.used;
+  if (window.count == 0 || sample.used > window.peak_used)
+  {
+    window.peak_used = sample.used;
+    window.peak_at = sample.at;
+  }
+  window.size = sample.size;
+  window.count++;
+}
+
+void disksize_temp_peaks_collect(const Disksize_snapshot *snapshot)
+{
+  temp_ring.drain(add_temp_sample);
+
+  // Forget the filesystems no temporary directory is on anymore
+  std::set<unsigned long long> devices;
+  for (const Disksize_record &row : snapshot->m_rows)
+    if (is_temp_variable(row.disksize_related_variable.view()))
+      devices.insert(row.disksize_device_id.val);
+  for (auto it = temp_windows.begin(); it != temp_windows.end();)
+  {
+    if (devices.count(it->first) == 0)
+      it = temp_windows.erase(it);
+    else
+      ++it;
+  }
+
+  Disksize_temp_peak_snapshot *peaks = new Disksize_temp_peak_snapshot;
+  for (const Disksize_record &row : snapshot->m_rows)
+  {
+    if (!is_temp_variable(row.disksize_related_variable.view()))
+      continue;
+    auto it = temp_windows.find(row.disksize_device_id.val);
+    if (it == temp_windows.end())
+      continue;
+
+    for (const Temp_window &window : it->second)
+    {
+      Disksize_temp_peak_record &record = peaks->m_rows.emplace_back();
+      record.m_related_variable = row.disksize_related_variable.view();
+      record.m_dir_name = row.disksize_dir_name.view();
+      record.m_device_id = it->first;
+      record.m_window_start = window.start;
+      record.m_sample_count = window.count;
+      record.m_size = window.size;
+      record.m_min_used = window.min_used;
+      record.m_peak_used = window.peak_used;
+      record.m_peak_at = window.peak_at;
+    }
+  }
+
+  temp_peak_publisher.publish(peaks);
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_temp_peak_st_share;
+
+typedef Disksize_snapshot_table<Disksize_temp_peak_snapshot,
+                                Disksize_temp_peak_record>
+    Disksize_temp_peak_table;
+
+static void read_temp_peak_column(const Disksize_temp_peak_record &row,
+                                  PSI_field *field, unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* RELATED_VARIABLE */
+    pfs_string->set_varchar_utf8mb4_len(
+        field, row.m_related_variable.data(),
+        (unsigned int)row.m_related_variable.length());
+    break;
+  case 1: /* DIR_NAME */
+    pfs_string->set_varchar_utf8mb4_len(field, row.m_dir_name.data(),
+                                        (unsigned int)row.m_dir_name.length());
+    break;
+  case 2: /* DEVICE_ID */
+    pfs_bigint->set_unsigned(field, {row.m_device_id, false});
+    break;
+  case 3: /* WINDOW_START */
+    pfs_timestamp->set2(field, row.m_window_start);
+    break;
+  case 4: /* SAMPLE_COUNT */
+    pfs_bigint->set_unsigned(field, {row.m_sample_count, false});
+    break;
+  case 5: /* SIZE */
+    pfs_bigint->set_unsigned(field, {row.m_size, false});
+    break;
+  case 6: /* MIN_USED */
+    pfs_bigint->set_unsigned(field, {row.m_min_used, false});
+    break;
+  case 7: /* PEAK_USED */
+    pfs_bigint->set_unsigned(field, {row.m_peak_used, false});
+    break;
+  case 8: /* PEAK_AT */
+    pfs_timestamp->set2(field, row.m_peak_at);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_temp_peak_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_temp_peaks";
+  share->m_table_name_length = 16;
+  share->m_table_definition =
+      "RELATED_VARIABLE varchar(60) not null, DIR_NAME varchar(255) not null, "
+      "DEVICE_ID bigint unsigned not null, WINDOW_START timestamp(6) not null, "
+      "SAMPLE_COUNT bigint unsigned not null, SIZE bigint unsigned not null, "
+      "MIN_USED bigint unsigned not null, PEAK_USED bigint unsigned not null, "
+      "PEAK_AT timestamp(6) not null";
+  Disksize_temp_peak_table::init_share<&temp_peak_publisher,
+                                       read_temp_peak_column>(share);
+}
@@ -0,0 +1,282 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+  DATA
+*/
+
+static Disksize_publisher<Disksize_thread_io_snapshot> thread_io_publisher;
+
+void init_disksize_thread_io()
+{
+  thread_io_publisher.init(&LOCK_disksize_data);
+}
+
+/* Called once the collector is stopped and the table removed */
+void cleanup_disksize_thread_io()
+{
+  thread_io_publisher.cleanup();
+}
+
+/* The fields of /proc/self/task/<tid>/io used here */
+struct Disksize_thread_io_counters {
+  unsigned long long read_bytes;
+  unsigned long long write_bytes;
+  unsigned long long cancelled_write_bytes;
+};
+
+/* Previous sample of each thread, only used by the collector */
+struct Disksize_thread_io_thread {
+  Disksize_thread_io_counters counters;
+  unsigned long long read_at;
+  /* Sample the thread was last seen in, to forget the exited ones */
+  unsigned long long pass;
+};
+static std::unordered_map<unsigned long long, Disksize_thread_io_thread>
+    io_threads;
+static unsigned long long thread_io_pass = 0;
+
+/*
+  Read and parse one io file in a fixed buffer: the file is about 150
+  bytes, nothing is allocated per thread.
+*/
+static bool read_thread_io(int task_fd, const char *tid,
+                           Disksize_thread_io_counters *counters)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "%s/io", tid);
+  int fd = openat(task_fd, path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  char buffer[512];
+  ssize_t n = read(fd, buffer, sizeof(buffer));
+  close(fd);
+  if (n <= 0)
+    return false;
+
+  *counters = {0, 0, 0};
+  std::string_view remaining(buffer, n);
+  while (!remaining.empty())
+  {
+    size_t eol = remaining.find('\n');
+    std::string_view line = remaining.substr(0, eol);
+    remaining.remove_prefix(eol == std::string_view::npos ? remaining.size()
+                                                          : eol + 1);
+
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos)
+      continue;
+    std::string_view name = line.substr(0, colon);
+    std::string_view value = line.substr(colon + 1);
+    value.remove_prefix(std::min(value.find_first_not_of(' '), value.size()));
+
+    unsigned long long *field = nullptr;
+    if (name == "read_bytes")
+      field = &counters->read_bytes;
+    else if (name == "write_bytes")
+      field = &counters->write_bytes;
+    else if (name == "cancelled_write_bytes")
+      field = &counters->cancelled_write_bytes;
+    if (field != nullptr)
+      std::from_chars(value.data(), value.data() + value.size(), *field);
+  }
+  return true;
+}
+
+static PSI_double rate(unsigned long long previous, unsigned long long current,
+                       double elapsed)
+{
+  return {(double)(current - previous) / elapsed, false};
+}
+
+/*
+  Threads whose counters did not move since the previous sample cost one
+  read of their io file and no row. The first sample of a thread has a row
+  only if it did some I/O, with NULL rates.
+*/
+void disksize_thread_io_sample(unsigned long long sampled_at)
+{
+  int task_fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (task_fd == -1)
+  {
+    io_threads.clear();
+    thread_io_publisher.publish(new Disksize_thread_io_snapshot);
+    return;
+  }
+  DIR *dirp = fdopendir(task_fd);
+  if (dirp == nullptr)
+  {
+    close(task_fd);
+    io_threads.clear();
+    thread_io_publisher.publish(new Disksize_thread_io_snapshot);
+    return;
+  }
+
+  thread_io_pass++;
+  unsigned long long read_at = disksize_now_ns();
+  Disksize_thread_io_snapshot *snapshot = new Disksize_thread_io_snapshot;
+  struct dirent *entry;
+
+  while ((entry = readdir(dirp)) != nullptr)
+  {
+    unsigned long long tid = 0;
+    const char *name = entry->d_name;
+    auto parsed = std::from_chars(name, name + strlen(name), tid);
+    if (parsed.ec != std::errc() || *parsed.ptr != '\0')
+      continue; /* . and .. */
+
+    Disksize_thread_io_counters counters;
+    if (!read_thread_io(dirfd(dirp), name, &counters))
+      continue;
+
+    auto found = io_threads.find(tid);
+    bool known = (found != io_threads.end());
+    // A counter going backwards is a thread id reused: a new thread
+    if (known && (counters.read_bytes < found->second.counters.read_bytes ||
+                  counters.write_bytes < found->second.counters.write_bytes ||
+                  counters.cancelled_write_bytes <
+                      found->second.counters.cancelled_write_bytes))
+      known = false;
+
+    bool idle = known ? (counters.read_bytes ==
+                             found->second.counters.read_bytes &&
+                         counters.write_bytes ==
+                             found->second.counters.write_bytes &&
+                         counters.cancelled_write_bytes ==
+                             found->second.counters.cancelled_write_bytes)
+                      : (counters.read_bytes == 0 &&
+                         counters.write_bytes == 0 &&
+                         counters.cancelled_write_bytes == 0);
+
+    if (!idle)
+    {
+      Disksize_thread_io_record &row = snapshot->m_rows.emplace_back();
+      row.m_thread_os_id = tid;
+      row.m_read_bytes = counters.read_bytes;
+      row.m_write_bytes = counters.write_bytes;
+      row.m_cancelled_write_bytes = counters.cancelled_write_bytes;
+      row.m_read_bytes_per_sec = {0, true};
+      row.m_write_bytes_per_sec = {0, true};
+      row.m_cancelled_write_bytes_per_sec = {0, true};
+      row.m_sampled_at = sampled_at;
+
+      double elapsed =
+          known ? (read_at - found->second.read_at) / 1000000000.0 : 0;
+      if (elapsed > 0)
+      {
+        const Disksize_thread_io_counters &previous = found->second.counters;
+        row.m_read_bytes_per_sec =
+            rate(previous.read_bytes, counters.read_bytes, elapsed);
+        row.m_write_bytes_per_sec =
+            rate(previous.write_bytes, counters.write_bytes, elapsed);
+        row.m_cancelled_write_bytes_per_sec =
+            rate(previous.cancelled_write_bytes,
+                 counters.cancelled_write_bytes, elapsed);
+      }
+    }
+
+    io_threads[tid] = {counters, read_at, thread_io_pass};
+  }
+  closedir(dirp);
+
+  // Threads which exited are forgotten
+  for (auto it = io_threads.begin(); it != io_threads.end();)
+  {
+    if (it->second.pass != thread_io_pass)
+      it = io_threads.erase(it);
+    else
+      ++it;
+  }
+
+  thread_io_publisher.publish(snapshot);
+}
+
+/*
+  DATA access (performance schema table)
+*/
+
+/* Global share pointer for a table */
+PFS_engine_table_share_proxy disksize_thread_io_st_share;
+
+typedef Disksize_snapshot_table<Disksize_thread_io_snapshot,
+                                Disksize_thread_io_record>
+    Disksize_thread_io_table;
+
+static void read_thread_io_column(const Disksize_thread_io_record &row,
+                                  PSI_field *field, unsigned int index)
+{
+  switch (index)
+  {
+  case 0: /* THREAD_OS_ID */
+    pfs_bigint->set_unsigned(field, {row.m_thread_os_id, false});
+    break;
+  case 1: /* READ_BYTES */
+    pfs_bigint->set_unsigned(field, {row.m_read_bytes, false});
+    break;
+  case 2: /* WRITE_BYTES */
+    pfs_bigint->set_unsigned(field, {row.m_write_bytes, false});
+    break;
+  case 3: /* CANCELLED_WRITE_BYTES */
+    pfs_bigint->set_unsigned(field, {row.m_cancelled_write_bytes, false});
+    break;
+  case 4: /* READ_BYTES_PER_SEC */
+    pfs_double->set(field, row.m_read_bytes_per_sec);
+    break;
+  case 5: /* WRITE_BYTES_PER_SEC */
+    pfs_double->set(field, row.m_write_bytes_per_sec);
+    break;
+  case 6: /* CANCELLED_WRITE_BYTES_PER_SEC */
+    pfs_double->set(field, row.m_cancelled_write_bytes_per_sec);
+    break;
+  case 7: /* SAMPLED_AT */
+    pfs_timestamp->set2(field, row.m_sampled_at);
+    break;
+  default: /* We should never reach here */
+    break;
+  }
+}
+
+void init_disksize_thread_io_share(PFS_engine_table_share_proxy *share)
+{
+  share->m_table_name = "disks_thread_io";
+  share->m_table_name_length = 15;
+  share->m_table_definition =
+      "THREAD_OS_ID bigint unsigned not null, "
+      "READ_BYTES bigint unsigned not null, "
+      "WRITE_BYTES bigint unsigned not null, "
+      "CANCELLED_WRITE_BYTES bigint unsigned not null, "
+      "READ_BYTES_PER_SEC double, WRITE_BYTES_PER_SEC double, "
+      "CANCELLED_WRITE_BYTES_PER_SEC double, "
+      "SAMPLED_AT timestamp(6) not null";
+  Disksize_thread_io_table::init_share<&thread_io_publisher,
+                                       read_thread_io_column>(share);
+}
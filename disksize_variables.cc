@@ -0,0 +1,176 @@
+/* Copyright (c) 2017, 2023, Oracle and/or its affiliates. All rights reserved.
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License, version 2.0,
+  as published by the Free Software Foundation.
+  This program is also distributed with certain software (including
+  but not limited to OpenSSL) that is licensed under separate terms,
+  as designated in a particular file or component or in included license
+  documentation.  The authors of MySQL hereby grant you an additional
+  permission to link the program and your derivative works with the
+  separately licensed software that they have included with MySQL.
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License, version 2.0, for more details.
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+
+#include "components/disksize/disksize.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Declaration: Array of all variables we should parse
+std::vector<std::string> variables_to_parse{
+    "log_bin_basename",
+    "relay_log_basename",
+    "datadir",
+    "tmpdir",
+    "innodb_undo_directory",
+    "innodb_data_home_dir",
+    "innodb_log_group_home_dir",
+    "innodb_temp_tablespaces_dir",
+    "innodb_tmpdir",
+    "innodb_redo_log_archive_dirs",
+    "replica_load_tmpdir"};
+
+static std::string_view getPathName(std::string_view s)
+{
+
+  char sep = '/';
+
+#ifdef _WIN32
+  sep = '\\';
+#endif
+
+  size_t i = s.rfind(sep);
+  if (i != std::string_view::npos)
+  {
+    return (s.substr(0, i));
+  }
+
+  return ("");
+}
+
+/* Same order as variables_to_parse, only used by the collector */
+static std::vector<Disksize_parsed_variable> parsed_variables;
+
+/* Reused for every get_variable(), grown when a value does not fit */
+static std::vector<char> value_buffer(1024);
+
+/* Call f for every non empty token of s */
+template <class F>
+static void for_each_token(std::string_view s, char separator, F f)
+{
+  while (!s.empty())
+  {
+    size_t end = s.find(separator);
+    std::string_view token = s.substr(0, end);
+    if (!token.empty())
+      f(token);
+    if (end == std::string_view::npos)
+      break;
+    s.remove_prefix(end + 1);
+  }
+}
+
+static void parse_variable_value(const std::string &variable,
+                                 std::string_view value,
+                                 Disksize_parsed_variable *parsed)
+{
+  parsed->paths.clear();
+
+  // Log basenames are a path plus a file name prefix
+  if (variable == "log_bin_basename" || variable == "relay_log_basename")
+    value = getPathName(value);
+
+  for_each_token(value, ';', [&](std::string_view entry) {
+    if (entry.find(':') == std::string_view::npos)
+    {
+      parsed->paths.emplace_back(variable, entry);
+      return;
+    }
+    // label:path pairs, the label is appended to the variable name
+    std::string_view label;
+    bool have_label = false;
+    for_each_token(entry, ':', [&](std::string_view token) {
+      if (!have_label)
+        label = token;
+      else
+      {
+        std::string related_variable = variable;
+        related_variable.append(" (").append(label).append(")");
+        parsed->paths.emplace_back(std::move(related_variable), token);
+      }
+      have_label = !have_label;
+    });
+  });
+}
+
+/* Read a server variable without truncating it, false on success */
+static bool get_server_variable(const char *name, std::string_view *value)
+{
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    char *buffer = value_buffer.data();
+    size_t length = value_buffer.size() - 1;
+
+    if (!mysql_service_component_sys_variable_register->get_variable(
+            "mysql_server", name, (void **)&buffer, &length))
+    {
+      *value = std::string_view(buffer, strnlen(buffer, value_buffer.size()));
+      return false;
+    }
+    // On failure length is the size needed when the buffer was too small
+    if (length < value_buffer.size())
+      break;
+    value_buffer.resize(length + 1);
+  }
+  return true;
+}
+
+void disksize_refresh_parsed_variables()
+{
+  char msgbuf[1024];
+  std::string_view value;
+
+  parsed_variables.resize(variables_to_parse.size());
+  for (size_t i = 0; i < variables_to_parse.size(); i++)
+  {
+    const std::string &variable = variables_to_parse[i];
+    Disksize_parsed_variable &parsed = parsed_variables[i];
+
+    if (get_server_variable(variable.c_str(), &value))
+    {
+      sprintf(msgbuf, "Could not get value of variable [%s]", variable.c_str());
+      LogComponentErr(ERROR_LEVEL, ER_LOG_PRINTF_MSG, msgbuf);
+      parsed.paths.clear();
+      parsed.parsed = false;
+      continue;
+    }
+
+    // Steady state: the value did not change, nothing to parse
+    if (parsed.parsed && value == parsed.raw_value)
+      continue;
+
+    parsed.raw_value.assign(value.data(), value.size());
+    parse_variable_value(variable, value, &parsed);
+    parsed.parsed = true;
+  }
+}
+
+const std::vector<Disksize_parsed_variable> &disksize_parsed_variables()
+{
+  return parsed_variables;
+}
+
+const std::string &disksize_parsed_raw_value(std::string_view variable)
+{
+  static const std::string none;
+  for (size_t i = 0; i < parsed_variables.size(); i++)
+    if (variables_to_parse[i] == variable && parsed_variables[i].parsed)
+      return parsed_variables[i].raw_value;
+  return none;
+}